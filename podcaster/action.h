@@ -35,6 +35,8 @@ struct EpisodeExtra {
 };
 
 struct ShowMoreExtra {
+  std::string podcast_uri;
+  std::string episode_uri;
   std::string episode_title;
   std::string episode_description_short;
   std::string episode_description_long;
@@ -49,7 +51,7 @@ struct CleanupExtra {
 struct Action {
   ActionType type = ActionType::kIdle;
   std::variant<std::monostate, EpisodeExtra, ShowMoreExtra, CleanupExtra>
-      extra;
+      extra = {};
 };
 
 inline Action& operator|=(Action& lhs, const Action& rhs) {
@@ -8,8 +8,8 @@ cd "$APP_DIR"
 if pgrep "podcasterd" > /dev/null; then
     echo "Already running"
 else
-    nohup ./bin/podcasterd $DB_DIR &> server.log &
+    nohup ./bin/podcasterd "$DB_DIR" &> server.log &
     sleep 0.3
 fi
 
-./bin/podcaster_client &> client.log
\ No newline at end of file
+./bin/podcaster_client "$DB_DIR" &> client.log
\ No newline at end of file
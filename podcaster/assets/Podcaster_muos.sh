@@ -15,9 +15,9 @@ cd "$PODCASTER_DIR" || exit
 if pgrep "podcasterd" > /dev/null; then
     echo "Already running"
 else
-    nohup ./bin/podcasterd $DB_DIR &> server.log &
+    nohup ./bin/podcasterd "$DB_DIR" &> server.log &
 fi
 
 SET_VAR "system" "foreground_process" "podcaster_client"
 
-./bin/podcaster_client &> client.log
+./bin/podcaster_client "$DB_DIR" &> client.log
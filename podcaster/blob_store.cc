@@ -0,0 +1,85 @@
+// SPDX-FileCopyrightText: 2025 Tomas Krupka
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "podcaster/blob_store.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <spdlog/spdlog.h>
+
+#include "podcaster/file_utils.h"
+#include "podcaster/hash_utils.h"
+
+namespace podcaster {
+
+BlobStore::~BlobStore() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+bool BlobStore::Open(const std::filesystem::path& path) {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+  path_ = path;
+  fd_ = open(path_.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    spdlog::error("Failed to open blob store {}: {}", path_.string(),
+                  std::strerror(errno));
+    size_ = 0;
+    return false;
+  }
+  size_ = lseek(fd_, 0, SEEK_END);
+  return true;
+}
+
+BlobRef BlobStore::Put(std::string_view data) {
+  BlobRef ref;
+  ref.set_hash(fnv::Hash(data));
+  if (not file::WriteAll(fd_, data)) {
+    spdlog::error("Failed to write blob store {}: {}", path_.string(),
+                  std::strerror(errno));
+    // resync with the file, a partial write is garbage now
+    size_ = lseek(fd_, 0, SEEK_END);
+    return ref;
+  }
+  ref.set_offset(size_);
+  ref.set_size(data.size());
+  size_ += data.size();
+  return ref;
+}
+
+std::optional<std::string> BlobStore::Get(const BlobRef& ref) const {
+  std::string data(ref.size(), '\0');
+  size_t read = 0;
+  while (read < data.size()) {
+    ssize_t res = pread(fd_, data.data() + read, data.size() - read,
+                        static_cast<off_t>(ref.offset() + read));
+    if (res < 0 and errno == EINTR) {
+      continue;
+    }
+    if (res <= 0) {
+      spdlog::error("Failed to read blob store {}", path_.string());
+      return {};
+    }
+    read += res;
+  }
+  if (fnv::Hash(data) != ref.hash()) {
+    spdlog::error("Corrupted blob in {} at {}", path_.string(), ref.offset());
+    return {};
+  }
+  return data;
+}
+
+void BlobStore::Sync() {
+  if (fd_ >= 0 and fdatasync(fd_) != 0) {
+    spdlog::error("Failed to sync blob store {}: {}", path_.string(),
+                  std::strerror(errno));
+  }
+}
+
+}  // namespace podcaster
@@ -0,0 +1,45 @@
+// SPDX-FileCopyrightText: 2025 Tomas Krupka
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "podcaster/message.pb.h"
+
+namespace podcaster {
+
+// Append-only file of blobs addressed by offset, for data that is rarely
+// read and shouldn't live in the in-memory database (long descriptions).
+class BlobStore {
+ public:
+  BlobStore() = default;
+  ~BlobStore();
+
+  BlobStore(const BlobStore&) = delete;
+  BlobStore& operator=(const BlobStore&) = delete;
+  BlobStore(BlobStore&&) = delete;
+  BlobStore& operator=(BlobStore&&) = delete;
+
+  bool Open(const std::filesystem::path& path);
+
+  BlobRef Put(std::string_view data);
+
+  std::optional<std::string> Get(const BlobRef& ref) const;
+
+  // Make all blobs durable, call before persisting references to them.
+  void Sync();
+
+  uint64_t Size() const { return size_; }
+
+ private:
+  std::filesystem::path path_;
+  int fd_ = -1;
+  uint64_t size_ = 0;
+};
+
+}  // namespace podcaster
@@ -0,0 +1,71 @@
+// SPDX-FileCopyrightText: 2025 Tomas Krupka
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "podcaster/client_worker.h"
+
+#include <utility>
+
+#include <spdlog/spdlog.h>
+
+namespace podcaster {
+
+ClientWorker::ClientWorker(std::string name)
+    : name_(std::move(name)),
+      jobs_(kQueueSize),
+      callbacks_(kQueueSize),
+      thread_([this] { Worker(); }) {}
+
+ClientWorker::~ClientWorker() {
+  stopped_.store(true);
+  posted_.fetch_add(1);
+  posted_.notify_one();
+  thread_.join();
+}
+
+bool ClientWorker::Post(std::function<void()> job) {
+  if (not jobs_.TryPush(std::move(job))) {
+    spdlog::warn("{}: too many calls queued, dropping one", name_);
+    return false;
+  }
+  posted_.fetch_add(1, std::memory_order_release);
+  posted_.notify_one();
+  return true;
+}
+
+void ClientWorker::Reply(std::function<void()> callback) {
+  // the GUI drains the queue every frame, unless it is shutting down
+  while (not callbacks_.TryPush(std::move(callback))) {
+    if (stopped_.load()) {
+      return;
+    }
+    std::this_thread::yield();
+  }
+}
+
+void ClientWorker::RunCallbacks() {
+  while (auto callback = callbacks_.TryPop()) {
+    (*callback)();
+  }
+}
+
+bool ClientWorker::Busy() const {
+  return finished_.load(std::memory_order_acquire) !=
+         posted_.load(std::memory_order_acquire);
+}
+
+void ClientWorker::Worker() {
+  while (true) {
+    // read before draining, a job posted meanwhile ends the wait right away
+    uint32_t seen = posted_.load(std::memory_order_acquire);
+    while (auto job = jobs_.TryPop()) {
+      (*job)();
+      finished_.fetch_add(1, std::memory_order_release);
+    }
+    if (stopped_.load()) {
+      return;
+    }
+    posted_.wait(seen, std::memory_order_acquire);
+  }
+}
+
+}  // namespace podcaster
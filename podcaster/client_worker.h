@@ -0,0 +1,63 @@
+// SPDX-FileCopyrightText: 2025 Tomas Krupka
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include "podcaster/spsc_queue.h"
+
+namespace podcaster {
+
+// Runs blocking client calls off the render thread. The GUI thread posts
+// jobs, the worker runs them in order and hands results back as callbacks
+// which the GUI thread runs in RunCallbacks. Both directions are lock-free
+// queues, so a slow call never stalls a frame.
+class ClientWorker {
+ public:
+  static constexpr int kQueueSize = 64;
+
+  explicit ClientWorker(std::string name);
+  // Runs the jobs already posted, then joins the thread.
+  ~ClientWorker();
+
+  ClientWorker(const ClientWorker&) = delete;
+  ClientWorker& operator=(const ClientWorker&) = delete;
+  ClientWorker(ClientWorker&&) = delete;
+  ClientWorker& operator=(ClientWorker&&) = delete;
+
+  // GUI thread only, false if the job was dropped because kQueueSize jobs
+  // are already waiting.
+  bool Post(std::function<void()> job);
+
+  // From a running job only, the callback runs on the GUI thread. Waits
+  // while the GUI is kQueueSize callbacks behind.
+  void Reply(std::function<void()> callback);
+
+  // GUI thread only.
+  void RunCallbacks();
+
+  // GUI thread only, true while a posted job has not finished.
+  bool Busy() const;
+
+ private:
+  void Worker();
+
+  std::string name_;
+
+  SpscQueue<std::function<void()>> jobs_;
+  SpscQueue<std::function<void()>> callbacks_;
+
+  // bumped for every posted job, the worker sleeps on it
+  std::atomic<uint32_t> posted_ = 0;
+  std::atomic<uint32_t> finished_ = 0;
+  std::atomic_bool stopped_ = false;
+
+  std::thread thread_;
+};
+
+}  // namespace podcaster
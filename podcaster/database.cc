@@ -3,6 +3,672 @@
 
 #include "podcaster/database.h"
 
+#include <algorithm>
+#include <cinttypes>
+#include <climits>
+#include <cstdio>
+#include <fstream>
+#include <random>
+
+#include <google/protobuf/arena.h>
+#include <google/protobuf/util/field_mask_util.h>
+#include <spdlog/fmt/fmt.h>
+#include <spdlog/spdlog.h>
+
+#include "podcaster/file_utils.h"
+#include "podcaster/hash_utils.h"
+
 namespace podcaster {
 
-}
\ No newline at end of file
+constexpr uint64_t kMaxJournalSize = 512;
+constexpr uint64_t kMinDescriptionGarbage = 1024 * 1024;
+constexpr size_t kMinSnapshotArenaSize = 64 * 1024;
+
+constexpr int kDefaultPageSize = 100;
+constexpr int kMaxPageSize = 1000;
+
+// compaction alternates between two description store files
+constexpr std::string_view kDescriptionStorePrefix = "descriptions.";
+const std::string kDescriptionStores[2] = {"descriptions.0.bin",
+                                           "descriptions.1.bin"};
+
+// Hash of the fields that come from the feed, detects unchanged episodes.
+uint64_t ContentHash(const Episode& episode) {
+  uint64_t hash = fnv::Hash(episode.title());
+  hash = hash * 31 + fnv::Hash(episode.description_short());
+  hash = hash * 31 + fnv::Hash(episode.description_long());
+  return hash;
+}
+
+uint64_t NewEpoch() {
+  std::random_device device;
+  return (static_cast<uint64_t>(device()) << 32) | device();
+}
+
+// Page tokens point at the last episode of the previous page.
+std::string EncodePageToken(uint64_t epoch, utils::EpisodeSlot slot) {
+  return fmt::format("{:x}.{}.{}", epoch, slot.podcast, slot.episode);
+}
+
+std::optional<utils::EpisodeSlot> DecodePageToken(const std::string& token,
+                                                  uint64_t epoch) {
+  uint64_t token_epoch = 0;
+  utils::EpisodeSlot slot;
+  if (std::sscanf(token.c_str(), "%" SCNx64 ".%d.%d", &token_epoch,
+                  &slot.podcast, &slot.episode) != 3 or
+      token_epoch != epoch) {
+    return {};
+  }
+  return slot;
+}
+
+std::filesystem::path CreateDirectories(std::filesystem::path path) {
+  std::filesystem::create_directories(path);
+  return path;
+}
+
+Database::Database(std::filesystem::path data_dir)
+    : data_dir_(CreateDirectories(std::move(data_dir))),
+      epoch_(NewEpoch()),
+      journal_(data_dir_ / "journal.bin") {
+  std::filesystem::path file_path = data_dir_ / "db.bin";
+  std::ifstream file(file_path, std::ios::binary);
+  if (!file.is_open()) {
+    db_.set_db_path(data_dir_);
+  } else {
+    db_.ParseFromIstream(&file);
+    index_.Rebuild(db_);
+    status_index_.Rebuild(db_);
+  }
+  snapshot_sequence_ = db_.journal_sequence();
+
+  int replayed = journal_.Replay(
+      snapshot_sequence_,
+      [this](const EpisodeUpdate& update) { ApplyUpdate(update); });
+
+  if (replayed > 0) {
+    spdlog::info("Replayed {} journal entries", replayed);
+  }
+
+  bool descriptions_changed = OpenDescriptionStore();
+
+  persist_thread_ = std::thread([this] { PersistenceWorker(); });
+
+  if (replayed > 0 or descriptions_changed) {
+    SaveState();
+  }
+}
+
+Database::~Database() {
+  SaveState();
+  {
+    std::lock_guard<std::mutex> lock(persist_mutex_);
+    stop_ = true;
+  }
+  persist_cv_.notify_one();
+  persist_thread_.join();
+}
+
+const Podcast* Database::FindPodcast(const std::string& podcast_uri) const {
+  auto slot = index_.FindPodcast(podcast_uri);
+  if (not slot) {
+    return nullptr;
+  }
+  return &db_.podcasts(*slot);
+}
+
+Episode* Database::FindEpisodeMutable(const EpisodeUri& uri) {
+  auto slot = index_.FindEpisode(uri);
+  if (not slot) {
+    return nullptr;
+  }
+  return db_.mutable_podcasts(slot->podcast)->mutable_episodes(slot->episode);
+}
+
+const Episode* Database::FindEpisodeConst(const EpisodeUri& uri) const {
+  auto slot = index_.FindEpisode(uri);
+  if (not slot) {
+    return nullptr;
+  }
+  return &db_.podcasts(slot->podcast).episodes(slot->episode);
+}
+
+std::optional<Episode> Database::FindEpisode(const EpisodeUri& uri) const {
+  auto slot = index_.FindEpisode(uri);
+  if (not slot) {
+    return {};
+  }
+  return db_.podcasts(slot->podcast).episodes(slot->episode);
+}
+
+std::optional<std::string> Database::LoadDescription(
+    const EpisodeUri& uri) const {
+  auto slot = index_.FindEpisode(uri);
+  if (not slot) {
+    return {};
+  }
+  const auto& episode = db_.podcasts(slot->podcast).episodes(slot->episode);
+  if (not episode.has_description_long_ref()) {
+    return std::string{};
+  }
+  return description_store_.Get(episode.description_long_ref());
+}
+
+std::shared_ptr<const DatabaseState> Database::Snapshot() {
+  if (not snapshot_ or snapshot_version_ != version_) {
+    // Each snapshot lives on its own arena, sized after the previous one, so
+    // the copy allocates in a few large blocks and is freed at once when the
+    // last reader lets go of it.
+    google::protobuf::ArenaOptions options;
+    options.start_block_size =
+        std::max(kMinSnapshotArenaSize, snapshot_arena_size_);
+    options.max_block_size = options.start_block_size;
+    auto arena = std::make_shared<google::protobuf::Arena>(options);
+    auto* snapshot =
+        google::protobuf::Arena::CreateMessage<DatabaseState>(arena.get());
+    *snapshot = db_;
+    snapshot_arena_size_ = arena->SpaceAllocated();
+    // aliasing constructor, the snapshot keeps its arena alive
+    snapshot_ = std::shared_ptr<const DatabaseState>(arena, snapshot);
+    snapshot_version_ = version_;
+  }
+  return snapshot_;
+}
+
+uint64_t Database::ApplyUpdate(const EpisodeUpdate& update) {
+  if (auto slot = utils::ApplyUpdate(update, index_, &status_index_, &db_);
+      slot) {
+    version_++;
+    Touch(slot.value(), version_);
+  }
+  return version_;
+}
+
+void Database::TouchPodcast(int podcast_slot, uint64_t version) {
+  if (podcast_slot >= static_cast<int>(versions_.size())) {
+    versions_.resize(podcast_slot + 1);
+  }
+  versions_[podcast_slot].podcast = version;
+}
+
+void Database::Touch(utils::EpisodeSlot slot, uint64_t version) {
+  TouchPodcast(slot.podcast, version);
+  auto& episodes = versions_[slot.podcast].episodes;
+  if (slot.episode >= static_cast<int>(episodes.size())) {
+    episodes.resize(slot.episode + 1);
+  }
+  episodes[slot.episode] = version;
+}
+
+DatabaseState Database::Changes(uint64_t since_version) const {
+  DatabaseState result;
+  result.set_db_path(db_.db_path());
+  result.set_epoch(epoch_);
+  result.set_version(version_);
+  result.set_delta(true);
+
+  for (int p = 0; p < static_cast<int>(versions_.size()); p++) {
+    const auto& versions = versions_[p];
+    if (versions.podcast <= since_version) {
+      continue;
+    }
+    const auto& source = db_.podcasts(p);
+    auto* podcast = result.add_podcasts();
+    podcast->set_podcast_uri(source.podcast_uri());
+    podcast->set_title(source.title());
+    for (int e = 0; e < static_cast<int>(versions.episodes.size()); e++) {
+      if (versions.episodes[e] > since_version) {
+        *podcast->add_episodes() = source.episodes(e);
+      }
+    }
+  }
+  return result;
+}
+
+std::vector<EpisodeUri> Database::FindEpisodes(DownloadStatus status) const {
+  return ToUris(status_index_.WithStatus(status));
+}
+
+std::vector<EpisodeUri> Database::FindEpisodes(PlaybackStatus status) const {
+  return ToUris(status_index_.WithStatus(status));
+}
+
+DatabaseState Database::FilterEpisodes(const EpisodeFilter& filter) const {
+  DatabaseState result;
+  result.set_db_path(db_.db_path());
+
+  const utils::StatusIndex::Slots* slots = nullptr;
+  switch (filter.status_case()) {
+    case EpisodeFilter::StatusCase::kDownloadStatus:
+      slots = &status_index_.WithStatus(filter.download_status());
+      break;
+    case EpisodeFilter::StatusCase::kPlaybackStatus:
+      slots = &status_index_.WithStatus(filter.playback_status());
+      break;
+    default:
+      return result;
+  }
+
+  Podcast* podcast = nullptr;
+  int podcast_slot = -1;
+  for (const auto& slot : *slots) {
+    const auto& source = db_.podcasts(slot.podcast);
+    if (slot.podcast != podcast_slot) {
+      podcast = result.add_podcasts();
+      podcast->set_podcast_uri(source.podcast_uri());
+      podcast->set_title(source.title());
+      podcast_slot = slot.podcast;
+    }
+    *podcast->add_episodes() = source.episodes(slot.episode);
+  }
+  return result;
+}
+
+std::optional<QueryResponse> Database::Query(
+    const QueryRequest& request) const {
+  QueryResponse response;
+  response.set_epoch(epoch_);
+  response.set_version(version_);
+  response.set_db_path(db_.db_path());
+
+  // last episode of the previous page
+  std::optional<utils::EpisodeSlot> start;
+  if (not request.page_token().empty()) {
+    start = DecodePageToken(request.page_token(), epoch_);
+    if (not start or start->podcast < 0 or
+        start->podcast >= db_.podcasts_size()) {
+      return {};
+    }
+  }
+
+  std::optional<int> podcast_filter;
+  if (not request.podcast_uri().empty()) {
+    podcast_filter = index_.FindPodcast(request.podcast_uri());
+    if (not podcast_filter) {
+      return response;
+    }
+  }
+
+  int page_size = request.page_size() > 0
+                      ? std::min(request.page_size(), kMaxPageSize)
+                      : kDefaultPageSize;
+  int count = 0;
+  Podcast* podcast = nullptr;
+  std::optional<utils::EpisodeSlot> last;
+
+  // false once the page is full and there are more episodes to come
+  auto add = [&](utils::EpisodeSlot slot) {
+    if (count == page_size) {
+      response.set_next_page_token(EncodePageToken(epoch_, last.value()));
+      return false;
+    }
+    const auto& source = db_.podcasts(slot.podcast);
+    if (not last or last->podcast != slot.podcast) {
+      podcast = response.add_podcasts();
+      podcast->set_podcast_uri(source.podcast_uri());
+      podcast->set_title(source.title());
+    }
+    auto* episode = podcast->add_episodes();
+    *episode = source.episodes(slot.episode);
+    if (request.episode_mask().paths_size() > 0) {
+      google::protobuf::util::FieldMaskUtil::TrimMessage(
+          request.episode_mask(), episode);
+    }
+    last = slot;
+    count++;
+    return true;
+  };
+
+  const utils::StatusIndex::Slots* slots = nullptr;
+  switch (request.filter().status_case()) {
+    case EpisodeFilter::StatusCase::kDownloadStatus:
+      slots = &status_index_.WithStatus(request.filter().download_status());
+      break;
+    case EpisodeFilter::StatusCase::kPlaybackStatus:
+      slots = &status_index_.WithStatus(request.filter().playback_status());
+      break;
+    default:
+      break;
+  }
+
+  if (slots) {
+    // the status index is kept in list order already
+    auto iter = slots->begin();
+    if (start and (not podcast_filter or start->podcast >= *podcast_filter)) {
+      iter = slots->upper_bound(start.value());
+    } else if (podcast_filter) {
+      iter = slots->lower_bound({*podcast_filter, INT_MAX});
+    }
+    for (; iter != slots->end(); ++iter) {
+      if (podcast_filter and iter->podcast != *podcast_filter) {
+        break;
+      }
+      if (not add(*iter)) {
+        break;
+      }
+    }
+    return response;
+  }
+
+  int first_podcast = podcast_filter.value_or(0);
+  int last_podcast = podcast_filter.value_or(db_.podcasts_size() - 1);
+  if (start) {
+    first_podcast = std::max(first_podcast, start->podcast);
+  }
+  for (int p = first_podcast; p <= last_podcast; p++) {
+    int e = db_.podcasts(p).episodes_size() - 1;
+    if (start and p == start->podcast) {
+      e = std::min(e, start->episode - 1);
+    }
+    for (; e >= 0; e--) {
+      if (not add({p, e})) {
+        return response;
+      }
+    }
+  }
+  return response;
+}
+
+std::vector<EpisodeUri> Database::ToUris(
+    const utils::StatusIndex::Slots& slots) const {
+  std::vector<EpisodeUri> uris;
+  uris.reserve(slots.size());
+  for (const auto& slot : slots) {
+    const auto& podcast = db_.podcasts(slot.podcast);
+    auto& uri = uris.emplace_back();
+    uri.set_podcast_uri(podcast.podcast_uri());
+    uri.set_episode_uri(podcast.episodes(slot.episode).episode_uri());
+  }
+  return uris;
+}
+
+void Database::AppendToJournal(const EpisodeUpdate& update) {
+  AppendToJournal(std::span<const EpisodeUpdate>(&update, 1));
+}
+
+void Database::AppendToJournal(std::span<const EpisodeUpdate> updates) {
+  if (updates.empty()) {
+    return;
+  }
+  uint64_t sequence = 0;
+  for (const auto& update : updates) {
+    sequence = journal_.Append(update);
+  }
+  if (sequence - snapshot_sequence_ >= kMaxJournalSize) {
+    SaveState();
+  } else {
+    MarkDirty(nullptr);
+  }
+}
+
+void Database::SaveState() {
+  snapshot_sequence_ = journal_.Sequence();
+  if (db_.journal_sequence() != snapshot_sequence_) {
+    db_.set_journal_sequence(snapshot_sequence_);
+    version_++;
+  }
+  MarkDirty(Snapshot());
+}
+
+void Database::Flush() {
+  std::unique_lock<std::mutex> lock(persist_mutex_);
+  uint64_t target = generation_;
+  flush_requested_ = true;
+  persist_cv_.notify_one();
+  flushed_cv_.wait(lock, [&] { return flushed_generation_ >= target; });
+}
+
+PersistenceStats Database::GetPersistenceStats() const {
+  return {
+      .flushes = flushes_.load(),
+      .coalesced_saves = coalesced_saves_.load(),
+      .last_flush_latency =
+          std::chrono::microseconds(last_flush_latency_us_.load()),
+      .max_flush_latency =
+          std::chrono::microseconds(max_flush_latency_us_.load()),
+      .snapshots = snapshots_.load(),
+      .snapshot_bytes = snapshot_bytes_.load(),
+  };
+}
+
+void Database::MarkDirty(std::shared_ptr<const DatabaseState> snapshot) {
+  {
+    std::lock_guard<std::mutex> lock(persist_mutex_);
+    if (snapshot) {
+      // an older pending snapshot is superseded
+      pending_snapshot_ = std::move(snapshot);
+    }
+    generation_++;
+  }
+  persist_cv_.notify_one();
+}
+
+void Database::PersistenceWorker() {
+  std::unique_lock<std::mutex> lock(persist_mutex_);
+  while (true) {
+    persist_cv_.wait(
+        lock, [this] { return stop_ or generation_ != flushed_generation_; });
+    if (generation_ == flushed_generation_) {
+      break;  // stopped, nothing left to write
+    }
+
+    // debounce, unless shutting down or someone waits in Flush
+    persist_cv_.wait_for(lock, kFlushDebounce,
+                         [this] { return stop_ or flush_requested_; });
+    flush_requested_ = false;
+
+    auto snapshot = std::move(pending_snapshot_);
+    pending_snapshot_.reset();
+    uint64_t target = generation_;
+    uint64_t num_requests = target - flushed_generation_;
+    lock.unlock();
+
+    auto start = std::chrono::steady_clock::now();
+    if (snapshot) {
+      description_store_.Sync();
+      std::string data;
+      if (not snapshot->SerializeToString(&data)) {
+        spdlog::error("Failed to serialize database");
+      } else if (file::AtomicWrite(data_dir_ / "db.bin", data)) {
+        journal_.Truncate(snapshot->journal_sequence());
+        snapshots_++;
+        snapshot_bytes_ += data.size();
+        save_state_latency_.ObserveSince(start);
+      }
+    }
+    journal_.Flush();
+    auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+    flushes_++;
+    coalesced_saves_ += num_requests - 1;
+    last_flush_latency_us_ = latency;
+    if (latency > max_flush_latency_us_) {
+      max_flush_latency_us_ = latency;
+    }
+
+    lock.lock();
+    flushed_generation_ = target;
+    flushed_cv_.notify_all();
+  }
+}
+
+std::vector<EpisodeUri> Database::SavePodcast(Podcast updated_podcast) {
+  return SavePodcast(&updated_podcast);
+}
+
+std::vector<EpisodeUri> Database::SavePodcast(Podcast* updated_podcast) {
+  std::vector<EpisodeUri> new_episodes;
+  bool changed = false;
+
+  if (auto slot = index_.FindPodcast(updated_podcast->podcast_uri()); slot) {
+    // existing podcast
+    auto* podcast = db_.mutable_podcasts(slot.value());
+    EpisodeUri uri;
+    uri.set_podcast_uri(podcast->podcast_uri());
+    for (auto& updated_episode : *updated_podcast->mutable_episodes()) {
+      uint64_t content_hash = ContentHash(updated_episode);
+      uri.set_episode_uri(updated_episode.episode_uri());
+      if (auto episode_slot = index_.FindEpisode(uri); episode_slot) {
+        // existing episode, skip it unless the feed changed it
+        auto* episode = podcast->mutable_episodes(episode_slot->episode);
+        if (episode->content_hash() != content_hash) {
+          UpdateEpisode(episode, &updated_episode);
+          episode->set_content_hash(content_hash);
+          Touch(episode_slot.value(), version_ + 1);
+          changed = true;
+        }
+      } else {
+        // new episode
+        auto* new_episode = podcast->add_episodes();
+        *new_episode = std::move(updated_episode);
+        new_episode->set_content_hash(content_hash);
+        StoreDescription(new_episode);
+        utils::EpisodeSlot new_slot{slot.value(), podcast->episodes_size() - 1};
+        index_.AddEpisode(uri.podcast_uri(), uri.episode_uri(), new_slot);
+        status_index_.AddEpisode(*new_episode, new_slot);
+        Touch(new_slot, version_ + 1);
+        // queue download
+        new_episodes.push_back(uri);
+        changed = true;
+      }
+    }
+  } else {
+    // new podcast
+    int latest_episode_index = updated_podcast->episodes_size() - 1;
+    if (latest_episode_index >= 0) {
+      EpisodeUri uri;
+      uri.set_podcast_uri(updated_podcast->podcast_uri());
+      uri.set_episode_uri(
+          updated_podcast->episodes(latest_episode_index).episode_uri());
+      new_episodes.push_back(uri);
+    }
+
+    int podcast_slot = db_.podcasts_size();
+    auto* podcast = db_.add_podcasts();
+    *podcast = std::move(*updated_podcast);
+
+    index_.AddPodcast(podcast->podcast_uri(), podcast_slot);
+    TouchPodcast(podcast_slot, version_ + 1);
+    for (int e = 0; e < podcast->episodes_size(); e++) {
+      auto* episode = podcast->mutable_episodes(e);
+      episode->set_content_hash(ContentHash(*episode));
+      StoreDescription(episode);
+      index_.AddEpisode(podcast->podcast_uri(), episode->episode_uri(),
+                        {podcast_slot, e});
+      status_index_.AddEpisode(*episode, {podcast_slot, e});
+      Touch({podcast_slot, e}, version_ + 1);
+    }
+    changed = true;
+  }
+
+  if (changed) {
+    version_++;
+  }
+  return new_episodes;
+}
+
+bool Database::OpenDescriptionStore() {
+  bool changed = false;
+  if (db_.description_store().empty()) {
+    db_.set_description_store(kDescriptionStores[0]);
+  }
+
+  // leftovers of an interrupted compaction, or of one that is now complete
+  for (const auto& entry : std::filesystem::directory_iterator(data_dir_)) {
+    auto filename = entry.path().filename().string();
+    if (filename.starts_with(kDescriptionStorePrefix) and
+        filename != db_.description_store()) {
+      std::filesystem::remove(entry.path());
+    }
+  }
+
+  description_store_.Open(data_dir_ / db_.description_store());
+
+  uint64_t live_bytes = 0;
+  for (auto& podcast : *db_.mutable_podcasts()) {
+    for (auto& episode : *podcast.mutable_episodes()) {
+      // moves descriptions of databases created before the store existed
+      changed |= StoreDescription(&episode);
+      live_bytes += episode.description_long_ref().size();
+    }
+  }
+
+  if (description_store_.Size() > 2 * live_bytes + kMinDescriptionGarbage) {
+    CompactDescriptionStore();
+    changed = true;
+  }
+
+  if (changed) {
+    version_++;
+  }
+  return changed;
+}
+
+void Database::CompactDescriptionStore() {
+  const auto& target = db_.description_store() == kDescriptionStores[0]
+                           ? kDescriptionStores[1]
+                           : kDescriptionStores[0];
+  spdlog::info("Compacting description store into {}", target);
+
+  BlobStore compacted;
+  std::filesystem::remove(data_dir_ / target);
+  if (not compacted.Open(data_dir_ / target)) {
+    return;
+  }
+
+  for (auto& podcast : *db_.mutable_podcasts()) {
+    for (auto& episode : *podcast.mutable_episodes()) {
+      if (not episode.has_description_long_ref()) {
+        continue;
+      }
+      if (auto data = description_store_.Get(episode.description_long_ref());
+          data) {
+        *episode.mutable_description_long_ref() = compacted.Put(data.value());
+      } else {
+        episode.clear_description_long_ref();
+      }
+    }
+  }
+  compacted.Sync();
+
+  // the old store is removed on the next start, once the snapshot
+  // referencing the new one is on disk
+  description_store_.Open(data_dir_ / target);
+  db_.set_description_store(target);
+}
+
+void Database::UpdateEpisode(Episode* episode, Episode* updated_episode) {
+  // like MergeFrom, but only touches fields that differ
+  auto update_field = [](std::string* field, std::string* updated_field) {
+    if (not updated_field->empty() and *field != *updated_field) {
+      *field = std::move(*updated_field);
+    }
+  };
+  update_field(episode->mutable_title(), updated_episode->mutable_title());
+  update_field(episode->mutable_description_short(),
+               updated_episode->mutable_description_short());
+  if (not updated_episode->description_long().empty()) {
+    episode->set_description_long(
+        std::move(*updated_episode->mutable_description_long()));
+    StoreDescription(episode);
+  }
+}
+
+bool Database::StoreDescription(Episode* episode) {
+  if (episode->description_long().empty()) {
+    return false;
+  }
+
+  const auto& ref = episode->description_long_ref();
+  if (not episode->has_description_long_ref() or
+      ref.hash() != fnv::Hash(episode->description_long())) {
+    *episode->mutable_description_long_ref() =
+        description_store_.Put(episode->description_long());
+  }
+  episode->clear_description_long();
+  return true;
+}
+
+}  // namespace podcaster
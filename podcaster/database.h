@@ -3,27 +3,45 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <filesystem>
-#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
 #include <vector>
 
+#include "podcaster/blob_store.h"
 #include "podcaster/database_utils.h"
+#include "podcaster/journal.h"
 #include "podcaster/message.pb.h"
+#include "podcaster/metrics.h"
 
 namespace podcaster {
+
+struct PersistenceStats {
+  uint64_t flushes = 0;
+  // persist requests that were merged into a flush of a later request
+  uint64_t coalesced_saves = 0;
+  std::chrono::microseconds last_flush_latency{0};
+  std::chrono::microseconds max_flush_latency{0};
+  // full state snapshots written, and their size in total
+  uint64_t snapshots = 0;
+  uint64_t snapshot_bytes = 0;
+};
+
 class Database {
  public:
-  explicit Database(std::filesystem::path data_dir) : data_dir_(data_dir) {
-    std::filesystem::path file_path = data_dir_ / "db.bin";
-    std::ifstream file(file_path, std::ios::binary);
-    if (!file.is_open()) {
-      db_.set_db_path(data_dir_);
-      return;
-    }
-    db_.ParseFromIstream(&file);
-  }
-
-  ~Database() { SaveState(); }
+  // Persist requests arriving within this window are written together.
+  static constexpr auto kFlushDebounce = std::chrono::milliseconds(250);
+
+  explicit Database(std::filesystem::path data_dir);
+
+  ~Database();
 
   Database(const Database&) = delete;
   Database& operator=(const Database&) = delete;
@@ -32,86 +50,136 @@ class Database {
 
   const DatabaseState& GetState() const { return db_; }
 
-  auto FindEpisodeMutable(const EpisodeUri& uri)
-      -> std::optional<
-          google::protobuf::internal::RepeatedPtrIterator<Episode>> {
-    return utils::FindEpisodeMutable(uri, &db_);
-  }
-
-  std::optional<Episode> FindEpisode(const EpisodeUri& uri) {
-    return utils::FindEpisode(uri, &db_);
-  }
-
-  void ApplyUpdate(const EpisodeUpdate& update) {
-    utils::ApplyUpdate(update, &db_);
-  }
-
-  void SaveState() {
-    std::filesystem::path file_path = data_dir_ / "db.bin";
-    std::ofstream file(file_path, std::ios::binary);
-    db_.SerializeToOstream(&file);
-  }
-
-  template <typename TEpisodeList>
-  bool UpdateEpisode(TEpisodeList* episode_list,
-                     const Episode& updated_episode) {
-    auto episode =
-        std::find_if(episode_list->begin(), episode_list->end(),
-                     [&updated_episode](const Episode& e) {
-                       return e.episode_uri() == updated_episode.episode_uri();
-                     });
-
-    if (episode != episode_list->end()) {
-      episode->MergeFrom(updated_episode);
-      return true;
-    }
-
-    return false;
-  }
-
-  std::vector<EpisodeUri> SavePodcast(const Podcast& updated_podcast) {
-    auto podcast = std::find_if(
-        db_.mutable_podcasts()->begin(), db_.mutable_podcasts()->end(),
-        [&updated_podcast](const Podcast& p) {
-          return p.podcast_uri() == updated_podcast.podcast_uri();
-        });
-
-    std::vector<EpisodeUri> new_episodes;
-
-    if (podcast != db_.mutable_podcasts()->end()) {
-      // existing podcast
-      for (const auto& updated_episode : updated_podcast.episodes()) {
-        if (UpdateEpisode(podcast->mutable_episodes(), updated_episode)) {
-          // existing episode was updated
-        } else {
-          // new episode
-          podcast->add_episodes()->CopyFrom(updated_episode);
-          // queue download
-          EpisodeUri uri;
-          uri.set_podcast_uri(podcast->podcast_uri());
-          uri.set_episode_uri(updated_episode.episode_uri());
-          new_episodes.push_back(uri);
-        }
-      }
-    } else {
-      // new podcast
-      db_.add_podcasts()->CopyFrom(updated_podcast);
-
-      int latest_episode_index = updated_podcast.episodes_size() - 1;
-      if (latest_episode_index >= 0) {
-        EpisodeUri uri;
-        uri.set_podcast_uri(updated_podcast.podcast_uri());
-        uri.set_episode_uri(
-            updated_podcast.episodes().at(latest_episode_index).episode_uri());
-        new_episodes.push_back(uri);
-      }
-    }
-
-    return new_episodes;
-  }
+  // Immutable copy of the state, shared by all readers until the next
+  // mutation. Only copies when the state changed since the last call.
+  std::shared_ptr<const DatabaseState> Snapshot();
+
+  // Incremented by every mutation.
+  uint64_t Version() const { return version_; }
+
+  // Random id of this instance, versions of different instances don't
+  // compare. A reloaded or recreated database starts a new epoch.
+  uint64_t Epoch() const { return epoch_; }
+
+  // Podcasts with only the episodes changed after since_version.
+  DatabaseState Changes(uint64_t since_version) const;
+
+  // One page of episodes, nullopt if the page token is invalid or comes
+  // from a different epoch.
+  std::optional<QueryResponse> Query(const QueryRequest& request) const;
+
+  // Through the index, null if there is no such podcast. Valid until the
+  // next mutation.
+  const Podcast* FindPodcast(const std::string& podcast_uri) const;
+
+  Episode* FindEpisodeMutable(const EpisodeUri& uri);
+
+  // Without the copy FindEpisode makes, valid until the next mutation.
+  const Episode* FindEpisodeConst(const EpisodeUri& uri) const;
+
+  std::optional<Episode> FindEpisode(const EpisodeUri& uri) const;
+
+  // Returns the version that includes the update.
+  uint64_t ApplyUpdate(const EpisodeUpdate& update);
+
+  // Episodes with the given status, answered from the status index.
+  std::vector<EpisodeUri> FindEpisodes(DownloadStatus status) const;
+
+  std::vector<EpisodeUri> FindEpisodes(PlaybackStatus status) const;
+
+  // Podcasts with only the episodes matching the filter, newest first.
+  DatabaseState FilterEpisodes(const EpisodeFilter& filter) const;
+
+  // Long descriptions are kept on disk, read them on demand. Empty if the
+  // episode has none, nullopt if it doesn't exist or can't be read.
+  std::optional<std::string> LoadDescription(const EpisodeUri& uri) const;
+
+  // Persist an already applied update with a journal append, the full state
+  // is only written out once the journal grows too long. Only marks the
+  // database dirty, the persistence worker does the disk I/O.
+  void AppendToJournal(const EpisodeUpdate& update);
+
+  // Same as above for several updates, marks the database dirty once.
+  void AppendToJournal(std::span<const EpisodeUpdate> updates);
+
+  // Queue a snapshot of the full state, compacting the journal. Serialized
+  // and written by the persistence worker.
+  void SaveState();
+
+  // Blocks until everything persisted so far is on disk.
+  void Flush();
+
+  PersistenceStats GetPersistenceStats() const;
+
+  // Time it took to write each full state snapshot, in seconds.
+  const Histogram& SaveStateLatency() const { return save_state_latency_; }
+
+  // Merges a freshly parsed feed, returns the episodes to download.
+  std::vector<EpisodeUri> SavePodcast(Podcast updated_podcast);
+
+  // Same as above, moves what it keeps out of the parsed feed. Episodes are
+  // copied if the feed lives on a different arena.
+  std::vector<EpisodeUri> SavePodcast(Podcast* updated_podcast);
 
  private:
+  void MarkDirty(std::shared_ptr<const DatabaseState> snapshot);
+
+  bool OpenDescriptionStore();
+
+  void CompactDescriptionStore();
+
+  // Moves the long description of the episode into the description store.
+  bool StoreDescription(Episode* episode);
+
+  void UpdateEpisode(Episode* episode, Episode* updated_episode);
+
+  void PersistenceWorker();
+
+  // Record the version of the last change of a podcast / episode.
+  void TouchPodcast(int podcast_slot, uint64_t version);
+
+  void Touch(utils::EpisodeSlot slot, uint64_t version);
+
+  std::vector<EpisodeUri> ToUris(const utils::StatusIndex::Slots& slots) const;
+
   std::filesystem::path data_dir_;
+  uint64_t epoch_;
   DatabaseState db_;
+  utils::EpisodeIndex index_;
+  utils::StatusIndex status_index_;
+  Journal journal_;
+  BlobStore description_store_;
+  uint64_t snapshot_sequence_ = 0;
+
+  uint64_t version_ = 0;
+  // last change of every podcast and episode, by slot
+  struct ItemVersions {
+    uint64_t podcast = 0;
+    std::vector<uint64_t> episodes;
+  };
+  std::vector<ItemVersions> versions_;
+  uint64_t snapshot_version_ = 0;
+  size_t snapshot_arena_size_ = 0;
+  std::shared_ptr<const DatabaseState> snapshot_;
+
+  // persistence worker state
+  std::mutex persist_mutex_;
+  std::condition_variable persist_cv_;
+  std::condition_variable flushed_cv_;
+  std::shared_ptr<const DatabaseState> pending_snapshot_;
+  uint64_t generation_ = 0;
+  uint64_t flushed_generation_ = 0;
+  bool flush_requested_ = false;
+  bool stop_ = false;
+
+  std::atomic<uint64_t> flushes_ = 0;
+  std::atomic<uint64_t> coalesced_saves_ = 0;
+  std::atomic<int64_t> last_flush_latency_us_ = 0;
+  std::atomic<int64_t> max_flush_latency_us_ = 0;
+  std::atomic<uint64_t> snapshots_ = 0;
+  std::atomic<uint64_t> snapshot_bytes_ = 0;
+  Histogram save_state_latency_{Histogram::LatencyBounds()};
+
+  std::thread persist_thread_;
 };
-}  // namespace podcaster
\ No newline at end of file
+}  // namespace podcaster
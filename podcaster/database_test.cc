@@ -0,0 +1,722 @@
+#include "podcaster/database.h"
+
+#include <fstream>
+#include <signal.h>  // NOLINT(modernize-deprecated-headers)
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include <spdlog/fmt/fmt.h>
+
+#include "podcaster/hash_utils.h"
+#include "podcaster/test_utils.h"
+
+using podcaster::testing::TempDataDir;
+
+namespace {
+
+podcaster::Podcast MakePodcast(const std::string& podcast_uri,
+                               int num_episodes) {
+  podcaster::Podcast podcast;
+  podcast.set_podcast_uri(podcast_uri);
+  podcast.set_title(podcast_uri);
+  for (int i = 0; i < num_episodes; i++) {
+    auto* episode = podcast.add_episodes();
+    episode->set_episode_uri(fmt::format("{}/{}.mp3", podcast_uri, i));
+    episode->set_title(fmt::format("Episode {}", i));
+  }
+  return podcast;
+}
+
+podcaster::EpisodeUri MakeUri(const std::string& podcast_uri,
+                              const std::string& episode_uri) {
+  podcaster::EpisodeUri uri;
+  uri.set_podcast_uri(podcast_uri);
+  uri.set_episode_uri(episode_uri);
+  return uri;
+}
+
+}  // namespace
+
+TEST_CASE("Find episodes through the index") {
+  podcaster::Database db(TempDataDir("find"));
+  db.SavePodcast(MakePodcast("pod1", 3));
+  db.SavePodcast(MakePodcast("pod2", 3));
+
+  auto episode = db.FindEpisode(MakeUri("pod2", "pod2/1.mp3"));
+  REQUIRE(episode);
+  REQUIRE(episode->title() == "Episode 1");
+
+  REQUIRE_FALSE(db.FindEpisode(MakeUri("pod1", "pod2/1.mp3")));
+  REQUIRE_FALSE(db.FindEpisode(MakeUri("pod3", "pod3/1.mp3")));
+  REQUIRE(db.FindEpisodeConst(MakeUri("pod2", "pod2/1.mp3"))->title() ==
+          "Episode 1");
+  REQUIRE_FALSE(db.FindEpisodeConst(MakeUri("pod3", "pod3/1.mp3")));
+
+  auto* podcast = db.FindPodcast("pod2");
+  REQUIRE(podcast);
+  REQUIRE(podcast->episodes_size() == 3);
+  REQUIRE_FALSE(db.FindPodcast("pod3"));
+}
+
+TEST_CASE("Index follows podcast updates") {
+  podcaster::Database db(TempDataDir("update"));
+  db.SavePodcast(MakePodcast("pod1", 2));
+
+  auto new_episodes = db.SavePodcast(MakePodcast("pod1", 4));
+  REQUIRE(new_episodes.size() == 2);
+  REQUIRE(new_episodes[0].episode_uri() == "pod1/2.mp3");
+  REQUIRE(new_episodes[1].episode_uri() == "pod1/3.mp3");
+
+  podcaster::EpisodeUpdate update;
+  update.mutable_uri()->CopyFrom(MakeUri("pod1", "pod1/3.mp3"));
+  update.set_new_download_status(podcaster::DownloadStatus::DOWNLOAD_SUCCESS);
+  db.ApplyUpdate(update);
+
+  REQUIRE(db.FindEpisode(update.uri())->download_status() ==
+          podcaster::DownloadStatus::DOWNLOAD_SUCCESS);
+  REQUIRE(db.GetState().podcasts(0).episodes_size() == 4);
+}
+
+TEST_CASE("Refreshing an unchanged feed leaves the state alone") {
+  podcaster::Database db(TempDataDir("unchanged"));
+  db.SavePodcast(MakePodcast("pod1", 3));
+
+  podcaster::EpisodeUpdate update;
+  update.mutable_uri()->CopyFrom(MakeUri("pod1", "pod1/1.mp3"));
+  update.set_new_playback_progress(1000);
+  db.ApplyUpdate(update);
+
+  auto version = db.Version();
+  REQUIRE(db.SavePodcast(MakePodcast("pod1", 3)).empty());
+  REQUIRE(db.Version() == version);
+
+  auto feed = MakePodcast("pod1", 3);
+  feed.mutable_episodes(1)->set_title("Renamed");
+  feed.mutable_episodes(2)->clear_title();
+  REQUIRE(db.SavePodcast(std::move(feed)).empty());
+  REQUIRE(db.Version() > version);
+
+  auto episode = db.FindEpisode(update.uri());
+  REQUIRE(episode->title() == "Renamed");
+  REQUIRE(episode->playback_progress().elapsed_ms() == 1000);
+  REQUIRE(db.FindEpisode(MakeUri("pod1", "pod1/2.mp3"))->title() ==
+          "Episode 2");
+}
+
+TEST_CASE("Index is rebuilt when loading from disk") {
+  auto data_dir = TempDataDir("reload");
+  {
+    podcaster::Database db(data_dir);
+    db.SavePodcast(MakePodcast("pod1", 2));
+    db.SavePodcast(MakePodcast("pod2", 2));
+  }
+
+  podcaster::Database db(data_dir);
+  auto episode = db.FindEpisode(MakeUri("pod2", "pod2/0.mp3"));
+  REQUIRE(episode);
+  REQUIRE(episode->title() == "Episode 0");
+}
+
+TEST_CASE("Status index follows updates") {
+  auto data_dir = TempDataDir("status");
+  auto set_status = [](podcaster::Database* db, const std::string& episode_uri,
+                       podcaster::DownloadStatus status) {
+    podcaster::EpisodeUpdate update;
+    update.mutable_uri()->CopyFrom(MakeUri("pod1", episode_uri));
+    update.set_new_download_status(status);
+    db->ApplyUpdate(update);
+    db->AppendToJournal(update);
+  };
+  {
+    podcaster::Database db(data_dir);
+    db.SavePodcast(MakePodcast("pod1", 3));
+    db.SavePodcast(MakePodcast("pod2", 2));
+    REQUIRE(db.FindEpisodes(podcaster::DownloadStatus::NOT_DOWNLOADED)
+                .size() == 5);
+
+    set_status(&db, "pod1/0.mp3", podcaster::DownloadStatus::DOWNLOAD_SUCCESS);
+    set_status(&db, "pod1/2.mp3", podcaster::DownloadStatus::DOWNLOAD_SUCCESS);
+    set_status(&db, "pod1/1.mp3", podcaster::DownloadStatus::DOWNLOAD_ERROR);
+    REQUIRE(db.FindEpisodes(podcaster::DownloadStatus::NOT_DOWNLOADED)
+                .size() == 2);
+  }
+
+  // rebuilt from the snapshot and the journal
+  podcaster::Database db(data_dir);
+  auto downloaded =
+      db.FindEpisodes(podcaster::DownloadStatus::DOWNLOAD_SUCCESS);
+  REQUIRE(downloaded.size() == 2);
+  REQUIRE(downloaded[0].episode_uri() == "pod1/2.mp3");
+  REQUIRE(downloaded[1].episode_uri() == "pod1/0.mp3");
+  REQUIRE(db.FindEpisodes(podcaster::DownloadStatus::DOWNLOAD_ERROR).size() ==
+          1);
+
+  podcaster::EpisodeFilter filter;
+  filter.set_download_status(podcaster::DownloadStatus::NOT_DOWNLOADED);
+  auto filtered = db.FilterEpisodes(filter);
+  REQUIRE(filtered.podcasts_size() == 1);
+  REQUIRE(filtered.podcasts(0).podcast_uri() == "pod2");
+  REQUIRE(filtered.podcasts(0).episodes_size() == 2);
+  REQUIRE(filtered.podcasts(0).episodes(0).episode_uri() == "pod2/1.mp3");
+
+  filter.set_playback_status(podcaster::PlaybackStatus::PLAYING);
+  REQUIRE(db.FilterEpisodes(filter).podcasts_size() == 0);
+}
+
+TEST_CASE("Changes since a version are merged into a client copy") {
+  podcaster::Database db(TempDataDir("changes"));
+  db.SavePodcast(MakePodcast("pod1", 3));
+  db.SavePodcast(MakePodcast("pod2", 3));
+
+  podcaster::DatabaseState client = *db.Snapshot();
+  client.set_epoch(db.Epoch());
+  client.set_version(db.Version());
+  podcaster::utils::EpisodeIndex index;
+  podcaster::utils::StatusIndex status_index;
+  index.Rebuild(client);
+  status_index.Rebuild(client);
+
+  REQUIRE(db.Changes(db.Version()).podcasts_size() == 0);
+
+  podcaster::EpisodeUpdate update;
+  update.mutable_uri()->CopyFrom(MakeUri("pod2", "pod2/1.mp3"));
+  update.set_new_download_status(podcaster::DownloadStatus::DOWNLOAD_SUCCESS);
+  db.ApplyUpdate(update);
+  db.SavePodcast(MakePodcast("pod1", 4));
+  db.SavePodcast(MakePodcast("pod3", 1));
+
+  auto changes = db.Changes(client.version());
+  REQUIRE(changes.delta());
+  REQUIRE(changes.podcasts_size() == 3);
+  REQUIRE(changes.podcasts(0).episodes_size() == 1);
+  REQUIRE(changes.podcasts(0).episodes(0).episode_uri() == "pod1/3.mp3");
+  REQUIRE(changes.podcasts(1).episodes_size() == 1);
+  REQUIRE(changes.podcasts(1).episodes(0).episode_uri() == "pod2/1.mp3");
+  REQUIRE(changes.podcasts(2).episodes_size() == 1);
+
+  podcaster::utils::MergeChanges(changes, &index, &status_index, &client);
+  REQUIRE(client.version() == db.Version());
+  REQUIRE(client.podcasts_size() == 3);
+  for (int p = 0; p < client.podcasts_size(); p++) {
+    REQUIRE(client.podcasts(p).SerializeAsString() ==
+            db.GetState().podcasts(p).SerializeAsString());
+  }
+  REQUIRE(
+      status_index.WithStatus(podcaster::DownloadStatus::DOWNLOAD_SUCCESS)
+          .size() == 1);
+
+  podcaster::Database other(TempDataDir("changes_other"));
+  REQUIRE(other.Epoch() != db.Epoch());
+}
+
+TEST_CASE("Updates pushed before a stale delta are applied again") {
+  podcaster::Database db(TempDataDir("changes_race"));
+  db.SavePodcast(MakePodcast("pod1", 2));
+
+  podcaster::DatabaseState client = *db.Snapshot();
+  client.set_epoch(db.Epoch());
+  client.set_version(db.Version());
+  podcaster::utils::EpisodeIndex index;
+  podcaster::utils::StatusIndex status_index;
+  index.Rebuild(client);
+  status_index.Rebuild(client);
+
+  podcaster::EpisodeUpdate update;
+  update.mutable_uri()->CopyFrom(MakeUri("pod1", "pod1/1.mp3"));
+  update.set_new_download_status(
+      podcaster::DownloadStatus::DOWNLOAD_IN_PROGRESS);
+  db.ApplyUpdate(update);
+  // the sync's delta is computed, then the download finishes and its update
+  // reaches the client first
+  auto changes = db.Changes(client.version());
+  update.set_new_download_status(podcaster::DownloadStatus::DOWNLOAD_SUCCESS);
+  update.set_version(db.ApplyUpdate(update));
+  REQUIRE(update.version() == db.Version());
+  podcaster::utils::ApplyUpdate(update, index, &status_index, &client);
+
+  podcaster::utils::MergeChanges(changes, &index, &status_index, &client);
+  REQUIRE(client.podcasts(0).episodes(1).download_status() ==
+          podcaster::DownloadStatus::DOWNLOAD_IN_PROGRESS);
+
+  podcaster::utils::ApplyNewerUpdates({update}, index, &status_index,
+                                      &client);
+  REQUIRE(client.podcasts(0).SerializeAsString() ==
+          db.GetState().podcasts(0).SerializeAsString());
+  REQUIRE(
+      status_index.WithStatus(podcaster::DownloadStatus::DOWNLOAD_SUCCESS)
+          .size() == 1);
+
+  // a delta that already includes the update leaves it alone
+  auto current = db.Changes(0);
+  podcaster::utils::MergeChanges(current, &index, &status_index, &client);
+  update.set_new_download_status(podcaster::DownloadStatus::DOWNLOAD_ERROR);
+  podcaster::utils::ApplyNewerUpdates({update}, index, &status_index,
+                                      &client);
+  REQUIRE(client.podcasts(0).episodes(1).download_status() ==
+          podcaster::DownloadStatus::DOWNLOAD_SUCCESS);
+}
+
+TEST_CASE("Query pages through filtered episodes") {
+  podcaster::Database db(TempDataDir("query"));
+  db.SavePodcast(MakePodcast("pod1", 5));
+  db.SavePodcast(MakePodcast("pod2", 3));
+
+  // collects the episode uris of all pages
+  auto query_all = [&db](podcaster::QueryRequest request) {
+    std::vector<std::string> uris;
+    do {
+      auto page = db.Query(request);
+      REQUIRE(page);
+      REQUIRE(page->epoch() == db.Epoch());
+      for (const auto& podcast : page->podcasts()) {
+        for (const auto& episode : podcast.episodes()) {
+          uris.push_back(episode.episode_uri());
+        }
+      }
+      request.set_page_token(page->next_page_token());
+    } while (not request.page_token().empty());
+    return uris;
+  };
+
+  podcaster::QueryRequest request;
+  request.set_page_size(3);
+
+  SECTION("All episodes, newest first") {
+    REQUIRE(query_all(request) ==
+            std::vector<std::string>{"pod1/4.mp3", "pod1/3.mp3", "pod1/2.mp3",
+                                     "pod1/1.mp3", "pod1/0.mp3", "pod2/2.mp3",
+                                     "pod2/1.mp3", "pod2/0.mp3"});
+  }
+
+  SECTION("Single podcast") {
+    request.set_podcast_uri("pod2");
+    REQUIRE(query_all(request) ==
+            std::vector<std::string>{"pod2/2.mp3", "pod2/1.mp3", "pod2/0.mp3"});
+
+    request.set_podcast_uri("pod3");
+    REQUIRE(query_all(request).empty());
+  }
+
+  SECTION("Status filter") {
+    for (const auto& uri : {MakeUri("pod1", "pod1/1.mp3"),
+                            MakeUri("pod1", "pod1/3.mp3"),
+                            MakeUri("pod2", "pod2/0.mp3")}) {
+      podcaster::EpisodeUpdate update;
+      *update.mutable_uri() = uri;
+      update.set_new_download_status(
+          podcaster::DownloadStatus::DOWNLOAD_SUCCESS);
+      db.ApplyUpdate(update);
+    }
+    request.set_page_size(1);
+    request.mutable_filter()->set_download_status(
+        podcaster::DownloadStatus::DOWNLOAD_SUCCESS);
+    REQUIRE(query_all(request) ==
+            std::vector<std::string>{"pod1/3.mp3", "pod1/1.mp3", "pod2/0.mp3"});
+
+    request.set_podcast_uri("pod2");
+    REQUIRE(query_all(request) == std::vector<std::string>{"pod2/0.mp3"});
+  }
+
+  SECTION("Field mask") {
+    request.mutable_episode_mask()->add_paths("episode_uri");
+    auto page = db.Query(request);
+    REQUIRE(page);
+    REQUIRE(page->podcasts(0).title() == "pod1");
+    const auto& episode = page->podcasts(0).episodes(0);
+    REQUIRE(episode.episode_uri() == "pod1/4.mp3");
+    REQUIRE(episode.title().empty());
+  }
+
+  SECTION("Invalid page tokens") {
+    request.set_page_token("garbage");
+    REQUIRE_FALSE(db.Query(request));
+
+    // tokens of another database instance
+    podcaster::Database other(TempDataDir("query_other"));
+    other.SavePodcast(MakePodcast("pod1", 5));
+    podcaster::QueryRequest other_request;
+    other_request.set_page_size(3);
+    request.set_page_token(other.Query(other_request)->next_page_token());
+    REQUIRE_FALSE(request.page_token().empty());
+    REQUIRE_FALSE(db.Query(request));
+  }
+}
+
+TEST_CASE("Persisted hashes don't depend on the platform") {
+  // reference values of 64-bit FNV-1a
+  REQUIRE(fnv::Hash("") == 0xcbf29ce484222325ull);
+  REQUIRE(fnv::Hash("a") == 0xaf63dc4c8601ec8cull);
+  REQUIRE(fnv::Hash("bar", fnv::Hash("foo")) == fnv::Hash("foobar"));
+}
+
+TEST_CASE("Long descriptions are kept in the description store") {
+  auto data_dir = TempDataDir("descriptions");
+  auto podcast = MakePodcast("pod1", 2);
+  podcast.mutable_episodes(1)->set_description_long("long description");
+  {
+    podcaster::Database db(data_dir);
+    db.SavePodcast(podcast);
+
+    const auto& episode = db.GetState().podcasts(0).episodes(1);
+    REQUIRE(episode.description_long().empty());
+    REQUIRE(episode.has_description_long_ref());
+    REQUIRE(db.LoadDescription(MakeUri("pod1", "pod1/1.mp3")) ==
+            "long description");
+    REQUIRE(db.LoadDescription(MakeUri("pod1", "pod1/0.mp3")) == "");
+
+    // unchanged descriptions are not stored again
+    auto ref = episode.description_long_ref();
+    db.SavePodcast(podcast);
+    REQUIRE(db.GetState().podcasts(0).episodes(1).description_long_ref()
+                .offset() == ref.offset());
+  }
+
+  podcaster::Database db(data_dir);
+  REQUIRE(db.LoadDescription(MakeUri("pod1", "pod1/1.mp3")) ==
+          "long description");
+}
+
+TEST_CASE("Descriptions of old databases are moved to the store") {
+  auto data_dir = TempDataDir("descriptions_migration");
+  {
+    podcaster::DatabaseState state;
+    auto* podcast = state.add_podcasts();
+    *podcast = MakePodcast("pod1", 1);
+    podcast->mutable_episodes(0)->set_description_long("long description");
+    std::ofstream file(data_dir / "db.bin", std::ios::binary);
+    state.SerializeToOstream(&file);
+  }
+
+  podcaster::Database db(data_dir);
+  REQUIRE(db.GetState().podcasts(0).episodes(0).description_long().empty());
+  REQUIRE(db.LoadDescription(MakeUri("pod1", "pod1/0.mp3")) ==
+          "long description");
+}
+
+TEST_CASE("Description store is compacted on startup") {
+  auto data_dir = TempDataDir("descriptions_compaction");
+  auto podcast = MakePodcast("pod1", 1);
+  {
+    podcaster::Database db(data_dir);
+    for (int i = 0; i < 100; i++) {
+      podcast.mutable_episodes(0)->set_description_long(
+          fmt::format("{}{}", i, std::string(64 * 1024, 'x')));
+      db.SavePodcast(podcast);
+    }
+  }
+  REQUIRE(std::filesystem::exists(data_dir / "descriptions.0.bin"));
+
+  {
+    podcaster::Database db(data_dir);
+    REQUIRE(db.LoadDescription(MakeUri("pod1", "pod1/0.mp3")) ==
+            podcast.episodes(0).description_long());
+  }
+
+  REQUIRE(std::filesystem::exists(data_dir / "descriptions.1.bin"));
+  REQUIRE(std::filesystem::file_size(data_dir / "descriptions.1.bin") ==
+          podcast.episodes(0).description_long().size());
+
+  podcaster::Database db(data_dir);
+  REQUIRE_FALSE(std::filesystem::exists(data_dir / "descriptions.0.bin"));
+  REQUIRE(db.LoadDescription(MakeUri("pod1", "pod1/0.mp3")) ==
+          podcast.episodes(0).description_long());
+}
+
+TEST_CASE("Snapshots are shared until the next mutation") {
+  podcaster::Database db(TempDataDir("snapshot"));
+  db.SavePodcast(MakePodcast("pod1", 2));
+
+  auto first = db.Snapshot();
+  REQUIRE(db.Snapshot() == first);
+
+  podcaster::EpisodeUpdate update;
+  update.mutable_uri()->CopyFrom(MakeUri("pod1", "pod1/1.mp3"));
+  update.set_new_playback_progress(1234);
+  db.ApplyUpdate(update);
+
+  auto second = db.Snapshot();
+  REQUIRE(second != first);
+  REQUIRE(first->podcasts(0).episodes(1).playback_progress().elapsed_ms() ==
+          0);
+  REQUIRE(second->podcasts(0).episodes(1).playback_progress().elapsed_ms() ==
+          1234);
+}
+
+TEST_CASE("Journaled updates survive a crash") {
+  auto data_dir = TempDataDir("journal");
+  auto crash_dir = TempDataDir("journal_crash");
+
+  podcaster::Database db(data_dir);
+  db.SavePodcast(MakePodcast("pod1", 2));
+  db.SaveState();
+
+  podcaster::EpisodeUpdate update;
+  update.mutable_uri()->CopyFrom(MakeUri("pod1", "pod1/1.mp3"));
+  update.set_new_playback_progress(1234);
+  db.ApplyUpdate(update);
+  db.AppendToJournal(update);
+  db.Flush();
+
+  // state on disk while db is still alive, as if the service was killed
+  std::filesystem::copy(data_dir, crash_dir,
+                        std::filesystem::copy_options::recursive);
+
+  podcaster::Database recovered(crash_dir);
+  REQUIRE(recovered.FindEpisode(update.uri())
+              ->playback_progress()
+              .elapsed_ms() == 1234);
+}
+
+TEST_CASE("Journaled update batches survive a crash") {
+  auto data_dir = TempDataDir("journal_batch");
+  auto crash_dir = TempDataDir("journal_batch_crash");
+
+  podcaster::Database db(data_dir);
+  db.SavePodcast(MakePodcast("pod1", 2));
+  db.SaveState();
+
+  std::vector<podcaster::EpisodeUpdate> updates(2);
+  updates[0].mutable_uri()->CopyFrom(MakeUri("pod1", "pod1/0.mp3"));
+  updates[0].set_new_playback_progress(100);
+  updates[1].mutable_uri()->CopyFrom(MakeUri("pod1", "pod1/1.mp3"));
+  updates[1].set_new_playback_progress(200);
+  for (const auto& update : updates) {
+    db.ApplyUpdate(update);
+  }
+  db.AppendToJournal(updates);
+  db.Flush();
+
+  std::filesystem::copy(data_dir, crash_dir,
+                        std::filesystem::copy_options::recursive);
+
+  podcaster::Database recovered(crash_dir);
+  REQUIRE(recovered.FindEpisode(updates[0].uri())
+              ->playback_progress()
+              .elapsed_ms() == 100);
+  REQUIRE(recovered.FindEpisode(updates[1].uri())
+              ->playback_progress()
+              .elapsed_ms() == 200);
+}
+
+TEST_CASE("Journal skips entries included in the snapshot") {
+  auto data_dir = TempDataDir("journal_replay");
+  auto journal_path = data_dir / "journal.bin";
+
+  podcaster::EpisodeUpdate update;
+  update.mutable_uri()->CopyFrom(MakeUri("pod1", "pod1/1.mp3"));
+  {
+    podcaster::Journal journal(journal_path);
+    for (int i = 1; i <= 3; i++) {
+      update.set_new_playback_progress(i);
+      journal.Append(update);
+    }
+  }
+
+  podcaster::Journal journal(journal_path);
+  std::vector<int> replayed;
+  REQUIRE(journal.Replay(1, [&](const podcaster::EpisodeUpdate& u) {
+            replayed.push_back(u.new_playback_progress());
+          }) == 2);
+  REQUIRE(replayed == std::vector<int>{2, 3});
+  REQUIRE(journal.Sequence() == 3);
+}
+
+TEST_CASE("Journal drops a torn entry") {
+  auto data_dir = TempDataDir("journal_torn");
+  auto journal_path = data_dir / "journal.bin";
+
+  podcaster::EpisodeUpdate update;
+  update.mutable_uri()->CopyFrom(MakeUri("pod1", "pod1/1.mp3"));
+  update.set_new_playback_progress(1);
+  {
+    podcaster::Journal journal(journal_path);
+    journal.Append(update);
+    journal.Append(update);
+  }
+  std::filesystem::resize_file(journal_path,
+                               std::filesystem::file_size(journal_path) - 2);
+
+  {
+    podcaster::Journal journal(journal_path);
+    REQUIRE(journal.Replay(0, [](const auto&) {}) == 1);
+    update.set_new_playback_progress(2);
+    journal.Append(update);
+  }
+
+  podcaster::Journal journal(journal_path);
+  int last_progress = 0;
+  REQUIRE(journal.Replay(0, [&](const podcaster::EpisodeUpdate& u) {
+            last_progress = u.new_playback_progress();
+          }) == 2);
+  REQUIRE(last_progress == 2);
+}
+
+TEST_CASE("Journal keeps entries newer than the snapshot") {
+  auto journal_path = TempDataDir("journal_truncate") / "journal.bin";
+
+  podcaster::EpisodeUpdate update;
+  update.mutable_uri()->CopyFrom(MakeUri("pod1", "pod1/1.mp3"));
+  {
+    podcaster::Journal journal(journal_path);
+    for (int i = 1; i <= 4; i++) {
+      update.set_new_playback_progress(i);
+      journal.Append(update);
+      if (i == 3) {
+        journal.Flush();
+      }
+    }
+    journal.Truncate(2);
+  }
+
+  podcaster::Journal journal(journal_path);
+  std::vector<int> replayed;
+  REQUIRE(journal.Replay(0, [&](const podcaster::EpisodeUpdate& u) {
+            replayed.push_back(u.new_playback_progress());
+          }) == 2);
+  REQUIRE(replayed == std::vector<int>{3, 4});
+}
+
+TEST_CASE("Journal truncation replaces the file") {
+  auto journal_path = TempDataDir("journal_replace") / "journal.bin";
+
+  podcaster::EpisodeUpdate update;
+  update.mutable_uri()->CopyFrom(MakeUri("pod1", "pod1/1.mp3"));
+  {
+    podcaster::Journal journal(journal_path);
+    for (int i = 1; i <= 3; i++) {
+      update.set_new_playback_progress(i);
+      journal.Append(update);
+    }
+  }
+  {
+    // the entries covered by the snapshot are only in the file
+    podcaster::Journal journal(journal_path);
+    REQUIRE(journal.Replay(2, [](const auto&) {}) == 1);
+    journal.Truncate(2);
+    update.set_new_playback_progress(4);
+    journal.Append(update);
+  }
+  REQUIRE_FALSE(std::filesystem::exists(journal_path.string() + ".tmp"));
+
+  podcaster::Journal journal(journal_path);
+  std::vector<int> replayed;
+  REQUIRE(journal.Replay(0, [&](const podcaster::EpisodeUpdate& u) {
+            replayed.push_back(u.new_playback_progress());
+          }) == 2);
+  REQUIRE(replayed == std::vector<int>{3, 4});
+}
+
+TEST_CASE("Journal covered by the snapshot is not saved again") {
+  auto data_dir = TempDataDir("journal_covered");
+  auto journal_path = data_dir / "journal.bin";
+  auto journal_copy = data_dir / "journal.copy";
+  {
+    podcaster::Database db(data_dir);
+    db.SavePodcast(MakePodcast("pod1", 2));
+    podcaster::EpisodeUpdate update;
+    update.mutable_uri()->CopyFrom(MakeUri("pod1", "pod1/1.mp3"));
+    for (int i = 1; i <= 2; i++) {
+      update.set_new_playback_progress(i);
+      db.ApplyUpdate(update);
+      db.AppendToJournal(update);
+    }
+    db.Flush();
+    std::filesystem::copy_file(journal_path, journal_copy);
+  }
+  // crash after the snapshot was written, before the journal was truncated
+  std::filesystem::rename(journal_copy, journal_path);
+
+  podcaster::Database db(data_dir);
+  REQUIRE(db.FindEpisode(MakeUri("pod1", "pod1/1.mp3"))
+              ->playback_progress()
+              .elapsed_ms() == 2);
+  db.Flush();
+  REQUIRE(db.GetPersistenceStats().snapshots == 0);
+}
+
+TEST_CASE("Persisted updates are coalesced by the worker") {
+  constexpr int kNumUpdates = 100;
+
+  auto data_dir = TempDataDir("coalesce");
+  {
+    podcaster::Database db(data_dir);
+    db.SavePodcast(MakePodcast("pod1", 2));
+
+    podcaster::EpisodeUpdate update;
+    update.mutable_uri()->CopyFrom(MakeUri("pod1", "pod1/1.mp3"));
+    for (int i = 1; i <= kNumUpdates; i++) {
+      update.set_new_playback_progress(i);
+      db.ApplyUpdate(update);
+      db.AppendToJournal(update);
+    }
+    db.Flush();
+
+    auto stats = db.GetPersistenceStats();
+    REQUIRE(stats.flushes >= 1);
+    REQUIRE(stats.flushes + stats.coalesced_saves == kNumUpdates);
+    REQUIRE(stats.coalesced_saves > 0);
+  }
+
+  podcaster::Database db(data_dir);
+  REQUIRE(db.FindEpisode(MakeUri("pod1", "pod1/1.mp3"))
+              ->playback_progress()
+              .elapsed_ms() == kNumUpdates);
+}
+
+TEST_CASE("Killing the writer mid-snapshot keeps the previous state") {
+  constexpr int kNumPodcasts = 50;
+  constexpr int kEpisodesPerPodcast = 200;
+  constexpr int kNumKills = 10;
+
+  auto data_dir = TempDataDir("snapshot_kill");
+
+  auto fill = [](podcaster::Database* db, const std::string& title) {
+    for (int p = 0; p < kNumPodcasts; p++) {
+      auto podcast =
+          MakePodcast(fmt::format("pod{}", p), kEpisodesPerPodcast);
+      for (auto& episode : *podcast.mutable_episodes()) {
+        episode.set_title(title);
+        episode.set_description_short(std::string(500, title[0]));
+      }
+      db->SavePodcast(podcast);
+    }
+  };
+
+  {
+    podcaster::Database db(data_dir);
+    fill(&db, "initial");
+  }
+
+  for (int i = 0; i < kNumKills; i++) {
+    pid_t writer = fork();
+    REQUIRE(writer >= 0);
+    if (writer == 0) {
+      // keep rewriting the snapshot until killed
+      podcaster::Database db(data_dir);
+      fill(&db, i % 2 == 0 ? "even" : "odd");
+      while (true) {
+        db.SaveState();
+      }
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100 + i * 37));
+    kill(writer, SIGKILL);
+    waitpid(writer, nullptr, 0);
+
+    podcaster::Database db(data_dir);
+    const auto& state = db.GetState();
+    REQUIRE(state.podcasts_size() == kNumPodcasts);
+
+    // every episode comes from the same complete snapshot
+    const auto& title = state.podcasts(0).episodes(0).title();
+    for (const auto& podcast : state.podcasts()) {
+      REQUIRE(podcast.episodes_size() == kEpisodesPerPodcast);
+      for (const auto& episode : podcast.episodes()) {
+        REQUIRE(episode.title() == title);
+      }
+    }
+  }
+}
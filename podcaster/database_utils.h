@@ -3,10 +3,198 @@
 
 #pragma once
 
+#include <array>
+#include <filesystem>
+#include <optional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 #include "podcaster/message.pb.h"
 
 namespace podcaster::utils {
 
+// Initial metadata the daemon sends once an EpisodeUpdates stream is live.
+inline constexpr char kUpdatesStreamKey[] = "podcaster-updates";
+
+// The daemon listens on a unix socket in its data directory by default.
+inline constexpr char kSocketName[] = "podcasterd.sock";
+
+inline std::string SocketAddress(const std::filesystem::path& data_dir) {
+  return "unix:" + (data_dir / kSocketName).string();
+}
+
+// A data directory stands for the socket in it, anything else is used as
+// a gRPC address, e.g. "localhost:50051".
+inline std::string ServerAddress(const std::string& arg) {
+  if (std::filesystem::is_directory(arg)) {
+    return SocketAddress(std::filesystem::absolute(arg));
+  }
+  return arg;
+}
+
+struct EpisodeSlot {
+  int podcast;
+  int episode;
+};
+
+// Maps podcast / episode uris to their positions in a DatabaseState. Podcasts
+// and episodes are only ever appended, so the slots stay valid until the
+// state is recreated.
+class EpisodeIndex {
+ public:
+  void Rebuild(const DatabaseState& state) {
+    podcasts_.clear();
+    for (int p = 0; p < state.podcasts_size(); p++) {
+      const auto& podcast = state.podcasts(p);
+      AddPodcast(podcast.podcast_uri(), p);
+      for (int e = 0; e < podcast.episodes_size(); e++) {
+        AddEpisode(podcast.podcast_uri(), podcast.episodes(e).episode_uri(),
+                   {p, e});
+      }
+    }
+  }
+
+  void AddPodcast(const std::string& podcast_uri, int slot) {
+    // keep the first occurrence, same as a linear search would
+    podcasts_.try_emplace(podcast_uri,
+                          PodcastEntry{.slot = slot, .episodes = {}});
+  }
+
+  void AddEpisode(const std::string& podcast_uri,
+                  const std::string& episode_uri, EpisodeSlot slot) {
+    auto podcast = podcasts_.find(podcast_uri);
+    if (podcast == podcasts_.end() or podcast->second.slot != slot.podcast) {
+      return;
+    }
+    podcast->second.episodes.try_emplace(episode_uri, slot.episode);
+  }
+
+  std::optional<int> FindPodcast(const std::string& podcast_uri) const {
+    auto podcast = podcasts_.find(podcast_uri);
+    if (podcast == podcasts_.end()) {
+      return {};
+    }
+    return podcast->second.slot;
+  }
+
+  std::optional<EpisodeSlot> FindEpisode(const EpisodeUri& uri) const {
+    auto podcast = podcasts_.find(uri.podcast_uri());
+    if (podcast == podcasts_.end()) {
+      return {};
+    }
+    auto episode = podcast->second.episodes.find(uri.episode_uri());
+    if (episode == podcast->second.episodes.end()) {
+      return {};
+    }
+    return EpisodeSlot{podcast->second.slot, episode->second};
+  }
+
+ private:
+  struct PodcastEntry {
+    int slot;
+    std::unordered_map<std::string, int> episodes;
+  };
+
+  std::unordered_map<std::string, PodcastEntry> podcasts_;
+};
+
+// Groups episodes by their download and playback status, so that filtered
+// views don't have to scan the whole state. Within a podcast the newest
+// episodes come first, the order they are listed in.
+class StatusIndex {
+ public:
+  struct ListOrder {
+    bool operator()(const EpisodeSlot& lhs, const EpisodeSlot& rhs) const {
+      if (lhs.podcast != rhs.podcast) {
+        return lhs.podcast < rhs.podcast;
+      }
+      return lhs.episode > rhs.episode;
+    }
+  };
+
+  using Slots = std::set<EpisodeSlot, ListOrder>;
+
+  void Rebuild(const DatabaseState& state) {
+    for (auto& slots : download_status_) {
+      slots.clear();
+    }
+    for (auto& slots : playback_status_) {
+      slots.clear();
+    }
+    for (int p = 0; p < state.podcasts_size(); p++) {
+      const auto& podcast = state.podcasts(p);
+      for (int e = 0; e < podcast.episodes_size(); e++) {
+        AddEpisode(podcast.episodes(e), {p, e});
+      }
+    }
+  }
+
+  void AddEpisode(const Episode& episode, EpisodeSlot slot) {
+    Insert(&download_status_, episode.download_status(), slot);
+    Insert(&playback_status_, episode.playback_status(), slot);
+  }
+
+  void RemoveEpisode(const Episode& episode, EpisodeSlot slot) {
+    Erase(&download_status_, episode.download_status(), slot);
+    Erase(&playback_status_, episode.playback_status(), slot);
+  }
+
+  // Call before the update is applied to the episode.
+  void Update(const EpisodeUpdate& update, const Episode& episode,
+              EpisodeSlot slot) {
+    switch (update.status_case()) {
+      case EpisodeUpdate::StatusCase::kNewDownloadStatus:
+        Erase(&download_status_, episode.download_status(), slot);
+        Insert(&download_status_, update.new_download_status(), slot);
+        break;
+      case EpisodeUpdate::StatusCase::kNewPlaybackStatus:
+        Erase(&playback_status_, episode.playback_status(), slot);
+        Insert(&playback_status_, update.new_playback_status(), slot);
+        break;
+      default:
+        break;
+    }
+  }
+
+  const Slots& WithStatus(DownloadStatus status) const {
+    return Find(download_status_, status);
+  }
+
+  const Slots& WithStatus(PlaybackStatus status) const {
+    return Find(playback_status_, status);
+  }
+
+ private:
+  // proto3 enums are open, values from newer versions are not indexed
+  template <typename Index>
+  static void Insert(Index* index, int status, EpisodeSlot slot) {
+    if (status >= 0 and status < static_cast<int>(index->size())) {
+      (*index)[status].insert(slot);
+    }
+  }
+
+  template <typename Index>
+  static void Erase(Index* index, int status, EpisodeSlot slot) {
+    if (status >= 0 and status < static_cast<int>(index->size())) {
+      (*index)[status].erase(slot);
+    }
+  }
+
+  template <typename Index>
+  static const Slots& Find(const Index& index, int status) {
+    static const Slots kEmpty;
+    if (status >= 0 and status < static_cast<int>(index.size())) {
+      return index[status];
+    }
+    return kEmpty;
+  }
+
+  std::array<Slots, DownloadStatus_ARRAYSIZE> download_status_;
+  std::array<Slots, PlaybackStatus_ARRAYSIZE> playback_status_;
+};
+
 inline std::optional<Episode> FindEpisode(const EpisodeUri& uri,
                                           DatabaseState* state) {
   auto podcast =
@@ -55,33 +243,101 @@ inline auto FindEpisodeMutable(const EpisodeUri& uri, DatabaseState* state)
   return episode;
 }
 
-inline void ApplyUpdate(const EpisodeUpdate& update, DatabaseState* state) {
-  auto episode = FindEpisodeMutable(update.uri(), state);
-  if (not episode) {
-    return;
-  }
-
+inline void ApplyUpdate(const EpisodeUpdate& update, Episode* episode) {
   switch (update.status_case()) {
     case EpisodeUpdate::StatusCase::kNewDownloadStatus:
-      episode.value()->set_download_status(update.new_download_status());
+      episode->set_download_status(update.new_download_status());
       break;
     case EpisodeUpdate::StatusCase::kNewDownloadProgress:
-      episode.value()->mutable_download_progress()->CopyFrom(
+      episode->mutable_download_progress()->CopyFrom(
           update.new_download_progress());
       break;
     case EpisodeUpdate::StatusCase::kNewPlaybackStatus:
-      episode.value()->set_playback_status(update.new_playback_status());
+      episode->set_playback_status(update.new_playback_status());
       break;
     case EpisodeUpdate::StatusCase::kNewPlaybackProgress:
-      episode.value()->mutable_playback_progress()->set_elapsed_ms(
+      episode->mutable_playback_progress()->set_elapsed_ms(
           update.new_playback_progress());
       break;
     case EpisodeUpdate::StatusCase::kNewPlaybackDuration:
-      episode.value()->mutable_playback_progress()->set_total_ms(
+      episode->mutable_playback_progress()->set_total_ms(
           update.new_playback_duration());
     default:
       break;
   }
 }
 
+inline void ApplyUpdate(const EpisodeUpdate& update, DatabaseState* state) {
+  if (auto episode = FindEpisodeMutable(update.uri(), state); episode) {
+    ApplyUpdate(update, &*episode.value());
+  }
+}
+
+// Same as above, but finds the episode through the index and keeps the
+// status index in sync. Returns the slot of the updated episode.
+inline std::optional<EpisodeSlot> ApplyUpdate(const EpisodeUpdate& update,
+                                              const EpisodeIndex& index,
+                                              StatusIndex* status_index,
+                                              DatabaseState* state) {
+  auto slot = index.FindEpisode(update.uri());
+  if (not slot) {
+    return {};
+  }
+  auto* episode =
+      state->mutable_podcasts(slot->podcast)->mutable_episodes(slot->episode);
+  status_index->Update(update, *episode, slot.value());
+  ApplyUpdate(update, episode);
+  return slot;
+}
+
+// Merges a delta from the State RPC: changed episodes replace the local
+// ones, new podcasts and episodes are appended in the order the daemon
+// added them, so the slots of both sides stay the same.
+inline void MergeChanges(const DatabaseState& changes, EpisodeIndex* index,
+                         StatusIndex* status_index, DatabaseState* state) {
+  for (const auto& changed_podcast : changes.podcasts()) {
+    auto podcast_slot = index->FindPodcast(changed_podcast.podcast_uri());
+    if (not podcast_slot) {
+      podcast_slot = state->podcasts_size();
+      state->add_podcasts()->set_podcast_uri(changed_podcast.podcast_uri());
+      index->AddPodcast(changed_podcast.podcast_uri(), podcast_slot.value());
+    }
+    auto* podcast = state->mutable_podcasts(podcast_slot.value());
+    podcast->set_title(changed_podcast.title());
+
+    EpisodeUri uri;
+    uri.set_podcast_uri(podcast->podcast_uri());
+    for (const auto& changed_episode : changed_podcast.episodes()) {
+      uri.set_episode_uri(changed_episode.episode_uri());
+      auto slot = index->FindEpisode(uri);
+      if (slot) {
+        auto* episode = podcast->mutable_episodes(slot->episode);
+        status_index->RemoveEpisode(*episode, slot.value());
+        *episode = changed_episode;
+      } else {
+        slot = EpisodeSlot{podcast_slot.value(), podcast->episodes_size()};
+        *podcast->add_episodes() = changed_episode;
+        index->AddEpisode(uri.podcast_uri(), uri.episode_uri(), slot.value());
+      }
+      status_index->AddEpisode(changed_episode, slot.value());
+    }
+  }
+  state->set_epoch(changes.epoch());
+  state->set_version(changes.version());
+}
+
+// A delta computed before the daemon pushed an update can arrive after it,
+// and the merge then reverts the update. Applies the updates the state's
+// version doesn't include yet once more.
+inline void ApplyNewerUpdates(const std::vector<EpisodeUpdate>& updates,
+                              const EpisodeIndex& index,
+                              StatusIndex* status_index,
+                              DatabaseState* state) {
+  for (const auto& update : updates) {
+    if (update.version() > state->version()) {
+      ApplyUpdate(update, index, status_index, state);
+    }
+  }
+}
+
 }  // namespace podcaster::utils
\ No newline at end of file
@@ -0,0 +1,112 @@
+// SPDX-FileCopyrightText: 2025 Tomas Krupka
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "podcaster/description_cache.h"
+
+#include <fstream>
+
+#include <spdlog/spdlog.h>
+
+#include "podcaster/file_utils.h"
+#include "podcaster/hash_utils.h"
+
+namespace podcaster {
+
+namespace {
+
+// bump when ParseDescription's output or the key's hash changes
+constexpr uint32_t kFormat = 2;
+
+}  // namespace
+
+DescriptionCache::DescriptionCache(std::filesystem::path path)
+    : path_(std::move(path)) {
+  std::ifstream file(path_, std::ios::binary);
+  if (not file.is_open()) {
+    cache_.set_format(kFormat);
+    return;
+  }
+  if (not cache_.ParseFromIstream(&file)) {
+    spdlog::warn("Ignoring corrupt description cache {}", path_.string());
+    cache_.Clear();
+  }
+  if (cache_.format() != kFormat) {
+    cache_.Clear();
+    cache_.set_format(kFormat);
+    dirty_ = true;
+  }
+}
+
+std::optional<ParsedDescription> DescriptionCache::Lookup(
+    std::string_view feed_uri, std::string_view html) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  auto iter = cache_.mutable_descriptions()->find(fnv::Hash(html));
+  if (iter == cache_.mutable_descriptions()->end() or
+      iter->second.input_size() != html.size()) {
+    return {};
+  }
+  auto& cached = iter->second;
+  if (cached.generation() != cache_.generation() or
+      cached.feed_uri() != feed_uri) {
+    cached.set_generation(cache_.generation());
+    cached.set_feed_uri(std::string(feed_uri));
+    dirty_ = true;
+  }
+  return ParsedDescription{cached.short_description(),
+                           cached.long_description()};
+}
+
+void DescriptionCache::Store(std::string_view feed_uri, std::string_view html,
+                             const ParsedDescription& parsed) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  auto& cached = (*cache_.mutable_descriptions())[fnv::Hash(html)];
+  cached.set_input_size(html.size());
+  cached.set_short_description(parsed.short_description);
+  cached.set_long_description(parsed.long_description);
+  cached.set_generation(cache_.generation());
+  cached.set_feed_uri(std::string(feed_uri));
+  dirty_ = true;
+}
+
+void DescriptionCache::KeepFeed(std::string_view feed_uri) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  kept_feeds_.emplace(feed_uri);
+}
+
+bool DescriptionCache::Save() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  auto* descriptions = cache_.mutable_descriptions();
+  for (auto iter = descriptions->begin(); iter != descriptions->end();) {
+    auto& cached = iter->second;
+    if (cached.generation() != cache_.generation() and
+        kept_feeds_.contains(cached.feed_uri())) {
+      cached.set_generation(cache_.generation());
+      dirty_ = true;
+    }
+    if (cached.generation() + kKeepGenerations <= cache_.generation()) {
+      iter = descriptions->erase(iter);
+      dirty_ = true;
+    } else {
+      iter++;
+    }
+  }
+  cache_.set_generation(cache_.generation() + 1);
+  kept_feeds_.clear();
+
+  if (not dirty_) {
+    return true;
+  }
+  if (not file::AtomicWrite(path_, cache_.SerializeAsString())) {
+    spdlog::error("Failed to write description cache {}", path_.string());
+    return false;
+  }
+  dirty_ = false;
+  return true;
+}
+
+size_t DescriptionCache::Size() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return cache_.descriptions_size();
+}
+
+}  // namespace podcaster
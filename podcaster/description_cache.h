@@ -0,0 +1,60 @@
+// SPDX-FileCopyrightText: 2025 Tomas Krupka
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+
+#include "podcaster/message.pb.h"
+
+namespace podcaster {
+
+struct ParsedDescription {
+  std::string short_description;
+  std::string long_description;
+};
+
+// Parsed episode descriptions keyed by a hash of their raw HTML, persisted
+// in the data directory so that a refresh only runs tidy on descriptions it
+// hasn't seen before. Descriptions not used by the last few refreshes are
+// dropped on Save, unless their feed was kept.
+class DescriptionCache {
+ public:
+  // refreshes a description is kept for without being used
+  static constexpr uint64_t kKeepGenerations = 3;
+
+  // Starts empty if the file is missing, corrupt or from another version of
+  // ParseDescription.
+  explicit DescriptionCache(std::filesystem::path path);
+
+  std::optional<ParsedDescription> Lookup(std::string_view feed_uri,
+                                          std::string_view html);
+
+  void Store(std::string_view feed_uri, std::string_view html,
+             const ParsedDescription& parsed);
+
+  // Counts the descriptions of a feed that wasn't parsed, e.g. because it
+  // didn't change, as used by the next Save.
+  void KeepFeed(std::string_view feed_uri);
+
+  // Drops the stale descriptions, writes the cache and starts the next
+  // generation.
+  bool Save();
+
+  size_t Size();
+
+ private:
+  std::filesystem::path path_;
+
+  std::mutex mtx_;
+  podcaster::DescriptionCacheState cache_;
+  bool dirty_ = false;
+  std::set<std::string, std::less<>> kept_feeds_;
+};
+
+}  // namespace podcaster
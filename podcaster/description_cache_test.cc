@@ -0,0 +1,75 @@
+#include "podcaster/description_cache.h"
+
+#include <fstream>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "podcaster/test_utils.h"
+
+using podcaster::testing::TempDataDir;
+
+TEST_CASE("Cached description survives a restart") {
+  auto path = TempDataDir("description_cache") / "description_cache.bin";
+  {
+    podcaster::DescriptionCache cache(path);
+    REQUIRE_FALSE(cache.Lookup("pod1", "<p>foo</p>"));
+    cache.Store("pod1", "<p>foo</p>", {"foo\n", "long"});
+    REQUIRE(cache.Save());
+  }
+
+  podcaster::DescriptionCache cache(path);
+  auto cached = cache.Lookup("pod1", "<p>foo</p>");
+  REQUIRE(cached);
+  REQUIRE(cached->short_description == "foo\n");
+  REQUIRE(cached->long_description == "long");
+  REQUIRE_FALSE(cache.Lookup("pod1", "<p>bar</p>"));
+}
+
+TEST_CASE("Unused descriptions are dropped after a few refreshes") {
+  auto path = TempDataDir("description_cache_evict") / "description_cache.bin";
+  podcaster::DescriptionCache cache(path);
+  cache.Store("pod1", "used", {"used", ""});
+  cache.Store("pod1", "unused", {"unused", ""});
+
+  // the refresh that stored them, then the ones not using "unused"
+  for (uint64_t i = 0; i <= podcaster::DescriptionCache::kKeepGenerations;
+       i++) {
+    REQUIRE(cache.Size() == 2);
+    REQUIRE(cache.Lookup("pod1", "used"));
+    REQUIRE(cache.Save());
+  }
+  REQUIRE(cache.Size() == 1);
+  REQUIRE(cache.Lookup("pod1", "used"));
+  REQUIRE_FALSE(cache.Lookup("pod1", "unused"));
+}
+
+TEST_CASE("Descriptions of kept feeds are not dropped") {
+  auto path = TempDataDir("description_cache_keep") / "description_cache.bin";
+  podcaster::DescriptionCache cache(path);
+  cache.Store("pod1", "unchanged", {"unchanged", ""});
+  cache.Store("pod2", "removed", {"removed", ""});
+
+  // pod1 isn't parsed again while its feed doesn't change
+  for (uint64_t i = 0; i <= podcaster::DescriptionCache::kKeepGenerations;
+       i++) {
+    cache.KeepFeed("pod1");
+    REQUIRE(cache.Save());
+  }
+  REQUIRE(cache.Size() == 1);
+  REQUIRE(cache.Lookup("pod1", "unchanged"));
+  REQUIRE_FALSE(cache.Lookup("pod2", "removed"));
+}
+
+TEST_CASE("Corrupt description cache starts empty") {
+  auto path =
+      TempDataDir("description_cache_corrupt") / "description_cache.bin";
+  {
+    std::ofstream file(path, std::ios::binary);
+    file << "not a protobuf";
+  }
+  podcaster::DescriptionCache cache(path);
+  REQUIRE(cache.Size() == 0);
+  cache.Store("pod1", "<p>foo</p>", {"foo", ""});
+  REQUIRE(cache.Save());
+  REQUIRE(podcaster::DescriptionCache(path).Size() == 1);
+}
@@ -0,0 +1,313 @@
+// SPDX-FileCopyrightText: 2025 Tomas Krupka
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "podcaster/feed_fetcher.h"
+
+#include <sys/select.h>
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <list>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string_view>
+
+#include <curlpp/Easy.hpp>
+#include <curlpp/Infos.hpp>
+#include <curlpp/Multi.hpp>
+#include <curlpp/Options.hpp>
+#include <spdlog/spdlog.h>
+
+#include "podcaster/file_utils.h"
+#include "podcaster/hash_utils.h"
+
+namespace podcaster {
+
+namespace {
+
+// how long to wait for socket activity before checking stop again
+constexpr auto kSelectTimeout = std::chrono::milliseconds(100);
+
+struct Transfer {
+  size_t index;
+  const FeedRequest* feed;
+  curlpp::Easy request;
+  std::string body;
+  // of the body bytes consumed
+  uint64_t body_hash = fnv::kOffset;
+  // the sink has seen enough, the transfer was ended on purpose
+  bool sink_done = false;
+  podcaster::FeedValidators validators;
+  std::chrono::steady_clock::time_point start;
+};
+
+size_t OnBody(Transfer* transfer, char* data, size_t size, size_t count) {
+  std::string_view chunk(data, size * count);
+  if (transfer->feed->sink) {
+    chunk = chunk.substr(0, transfer->feed->sink(chunk));
+    // anything short of the whole chunk makes curl abort the transfer
+    transfer->sink_done = chunk.size() < size * count;
+  } else {
+    transfer->body.append(chunk);
+  }
+  transfer->body_hash = fnv::Hash(chunk, transfer->body_hash);
+  return chunk.size();
+}
+
+// The trimmed value if the header line is the named header.
+std::optional<std::string_view> HeaderValue(std::string_view line,
+                                            std::string_view name) {
+  if (line.size() <= name.size() or line[name.size()] != ':' or
+      not std::equal(name.begin(), name.end(), line.begin(),
+                     [](char lhs, char rhs) {
+                       return std::tolower(lhs) == std::tolower(rhs);
+                     })) {
+    return {};
+  }
+  auto value = line.substr(name.size() + 1);
+  auto first = value.find_first_not_of(" \t");
+  auto last = value.find_last_not_of(" \t\r\n");
+  if (first == std::string_view::npos) {
+    return "";
+  }
+  return value.substr(first, last - first + 1);
+}
+
+size_t OnHeader(Transfer* transfer, char* data, size_t size, size_t count) {
+  std::string_view line(data, size * count);
+  if (line.starts_with("HTTP/")) {
+    // each response of a redirect chain starts over
+    transfer->validators.Clear();
+  } else if (auto etag = HeaderValue(line, "ETag")) {
+    transfer->validators.set_etag(std::string(*etag));
+  } else if (auto last_modified = HeaderValue(line, "Last-Modified")) {
+    transfer->validators.set_last_modified(std::string(*last_modified));
+  }
+  return size * count;
+}
+
+std::unique_ptr<Transfer> StartTransfer(size_t index, const FeedRequest& feed,
+                                        const TransferTimeouts& timeouts) {
+  auto transfer = std::make_unique<Transfer>();
+  transfer->index = index;
+  transfer->feed = &feed;
+  transfer->start = std::chrono::steady_clock::now();
+  auto& request = transfer->request;
+  request.setOpt<curlpp::options::Url>(feed.feed_uri);
+  request.setOpt<curlpp::options::WriteFunction>(
+      [transfer = transfer.get()](char* data, size_t size, size_t count) {
+        return OnBody(transfer, data, size, count);
+      });
+  request.setOpt<curlpp::options::HeaderFunction>(
+      [transfer = transfer.get()](char* data, size_t size, size_t count) {
+        return OnHeader(transfer, data, size, count);
+      });
+  request.setOpt<curlpp::options::FollowLocation>(true);
+  // curl decodes the body
+  request.setOpt<curlpp::options::Encoding>("gzip");
+  SetTimeouts(timeouts, &request);
+
+  std::list<std::string> headers;
+  if (not feed.validators.etag().empty()) {
+    headers.push_back("If-None-Match: " + feed.validators.etag());
+  }
+  if (not feed.validators.last_modified().empty()) {
+    headers.push_back("If-Modified-Since: " +
+                      feed.validators.last_modified());
+  }
+  if (not headers.empty()) {
+    request.setOpt<curlpp::options::HttpHeader>(headers);
+  }
+#ifdef PODCASTER_HANDHELD_BUILD
+  request.setOpt<curlpp::options::CaInfo>(
+      "/etc/ssl/certs/ca-certificates.crt");
+#endif
+  return transfer;
+}
+
+FetchedFeed FinishTransfer(Transfer* transfer, CURLcode code) {
+  FetchedFeed fetched;
+  fetched.fetch_time = std::chrono::steady_clock::now() - transfer->start;
+  if (code != CURLE_OK and
+      not (code == CURLE_WRITE_ERROR and transfer->sink_done)) {
+    fetched.error =
+        fmt::format("Failed to download feed: {}", curl_easy_strerror(code));
+    return fetched;
+  }
+
+  long status = curlpp::infos::ResponseCode::get(transfer->request);
+  if (status >= 400) {
+    fetched.error = fmt::format("Failed to download feed: HTTP {}", status);
+    return fetched;
+  }
+  if (status == 304) {
+    // the server may rotate its validators, or leave out the ones that
+    // still hold
+    fetched.validators = transfer->feed->validators;
+    if (not transfer->validators.etag().empty()) {
+      fetched.validators.set_etag(transfer->validators.etag());
+    }
+    if (not transfer->validators.last_modified().empty()) {
+      fetched.validators.set_last_modified(
+          transfer->validators.last_modified());
+    }
+    fetched.not_modified = true;
+  } else {
+    fetched.body = std::move(transfer->body);
+    fetched.validators = std::move(transfer->validators);
+    fetched.validators.set_body_hash(transfer->body_hash);
+  }
+  return fetched;
+}
+
+// Waits until a transfer can make progress, or for kSelectTimeout.
+void WaitForActivity(curlpp::Multi* multi) {
+  fd_set read_fds;
+  fd_set write_fds;
+  fd_set error_fds;
+  FD_ZERO(&read_fds);
+  FD_ZERO(&write_fds);
+  FD_ZERO(&error_fds);
+  int max_fd = -1;
+  multi->fdset(&read_fds, &write_fds, &error_fds, &max_fd);
+
+  auto timeout_us =
+      std::chrono::duration_cast<std::chrono::microseconds>(kSelectTimeout)
+          .count();
+  timeval timeout = {.tv_sec = 0, .tv_usec = timeout_us};
+  // no sockets yet, e.g. while resolving, select just sleeps
+  select(max_fd + 1, &read_fds, &write_fds, &error_fds, &timeout);
+}
+
+}  // namespace
+
+void SetTimeouts(const TransferTimeouts& timeouts, curlpp::Easy* request) {
+  request->setOpt<curlpp::options::ConnectTimeout>(timeouts.connect.count());
+  request->setOpt<curlpp::options::LowSpeedLimit>(timeouts.low_speed_limit);
+  request->setOpt<curlpp::options::LowSpeedTime>(
+      timeouts.low_speed_time.count());
+  request->setOpt<curlpp::options::Timeout>(timeouts.total.count());
+}
+
+void FetchFeeds(const std::vector<FeedRequest>& requests, int max_transfers,
+                const std::function<void(size_t, FetchedFeed)>& on_fetched,
+                const std::function<bool()>& stop,
+                const TransferTimeouts& timeouts,
+                const std::function<void()>& before_perform) {
+  max_transfers = std::max(max_transfers, 1);
+
+  curlpp::Multi multi;
+  std::map<const curlpp::Easy*, std::unique_ptr<Transfer>> active;
+  size_t next = 0;
+  std::string failure;
+
+  while (not stop() and (next < requests.size() or not active.empty())) {
+    while (next < requests.size() and
+           static_cast<int>(active.size()) < max_transfers) {
+      auto transfer = StartTransfer(next, requests[next], timeouts);
+      multi.add(&transfer->request);
+      active.emplace(&transfer->request, std::move(transfer));
+      next++;
+    }
+
+    int running = 0;
+    try {
+      if (before_perform) {
+        before_perform();
+      }
+      while (not multi.perform(&running)) {
+      }
+    } catch (const std::exception& e) {
+      spdlog::error("Feed transfers failed: {}", e.what());
+      failure = e.what();
+      break;
+    }
+
+    for (const auto& [request, info] : multi.info()) {
+      if (info.msg != CURLMSG_DONE) {
+        continue;
+      }
+      auto iter = active.find(request);
+      if (iter == active.end()) {
+        continue;
+      }
+      auto transfer = std::move(iter->second);
+      active.erase(iter);
+      multi.remove(&transfer->request);
+
+      auto fetched = FinishTransfer(transfer.get(), info.code);
+      if (not fetched.error.empty()) {
+        spdlog::error("{}: {}", requests[transfer->index].feed_uri,
+                      fetched.error);
+      }
+      on_fetched(transfer->index, std::move(fetched));
+    }
+
+    if (running > 0) {
+      WaitForActivity(&multi);
+    }
+  }
+
+  // the rest still get their result, in feed order
+  std::vector<size_t> unfinished;
+  for (const auto& [request, transfer] : active) {
+    multi.remove(request);
+    unfinished.push_back(transfer->index);
+  }
+  std::sort(unfinished.begin(), unfinished.end());
+  for (; next < requests.size(); next++) {
+    unfinished.push_back(next);
+  }
+  for (size_t index : unfinished) {
+    FetchedFeed skipped;
+    skipped.error = failure.empty()
+                        ? "Feed skipped, the refresh was stopped"
+                        : fmt::format("Failed to download feed: {}", failure);
+    on_fetched(index, std::move(skipped));
+  }
+}
+
+FeedCache::FeedCache(std::filesystem::path path) : path_(std::move(path)) {
+  std::ifstream file(path_, std::ios::binary);
+  if (file.is_open() and not cache_.ParseFromIstream(&file)) {
+    spdlog::warn("Ignoring corrupt feed cache {}", path_.string());
+    cache_.Clear();
+  }
+}
+
+podcaster::FeedValidators FeedCache::Lookup(const std::string& feed_uri) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  auto iter = cache_.feeds().find(feed_uri);
+  return iter == cache_.feeds().end() ? podcaster::FeedValidators{}
+                                      : iter->second;
+}
+
+void FeedCache::Store(const std::string& feed_uri,
+                      const podcaster::FeedValidators& validators) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  auto& stored = (*cache_.mutable_feeds())[feed_uri];
+  if (stored.etag() == validators.etag() and
+      stored.last_modified() == validators.last_modified() and
+      stored.body_hash() == validators.body_hash()) {
+    return;
+  }
+  stored = validators;
+  dirty_ = true;
+}
+
+bool FeedCache::Save() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (not dirty_) {
+    return true;
+  }
+  if (not file::AtomicWrite(path_, cache_.SerializeAsString())) {
+    spdlog::error("Failed to write feed cache {}", path_.string());
+    return false;
+  }
+  dirty_ = false;
+  return true;
+}
+
+}  // namespace podcaster
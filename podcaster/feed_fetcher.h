@@ -0,0 +1,98 @@
+// SPDX-FileCopyrightText: 2025 Tomas Krupka
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <curlpp/Easy.hpp>
+
+#include "podcaster/message.pb.h"
+
+namespace podcaster {
+
+// Fail a transfer whose server doesn't answer or stalls, instead of waiting
+// for it forever.
+struct TransferTimeouts {
+  std::chrono::seconds connect{15};
+  // slower than low_speed_limit bytes per second for low_speed_time
+  long low_speed_limit = 1;
+  std::chrono::seconds low_speed_time{30};
+  // of the whole transfer, zero for no limit
+  std::chrono::seconds total{120};
+};
+
+void SetTimeouts(const TransferTimeouts& timeouts, curlpp::Easy* request);
+
+struct FeedRequest {
+  std::string feed_uri;
+  // sent as If-None-Match and If-Modified-Since when set
+  podcaster::FeedValidators validators;
+  // Receives the body as it downloads instead of FetchedFeed::body, returns
+  // how much of the data it consumed. Consuming less than all of it means
+  // it has seen enough and ends the transfer.
+  std::function<size_t(std::string_view)> sink;
+};
+
+struct FetchedFeed {
+  std::string body;
+  // empty if the body was downloaded
+  std::string error;
+  // the server answered 304 Not Modified, the body is empty
+  bool not_modified = false;
+  // of this response, including the hash of the decoded body, or of the
+  // part of it the sink consumed; on 304 the request's, updated with the
+  // ones the server sent
+  podcaster::FeedValidators validators;
+  std::chrono::steady_clock::duration fetch_time{};
+};
+
+// Downloads the feeds over one curl multi handle, at most max_transfers at
+// a time, accepting gzip encoded bodies. on_fetched runs on the calling
+// thread as each transfer completes, in completion order, with the feed's
+// index. Blocks until all feeds are done or stop returns true, a transfer
+// past its timeouts fails.
+//
+// on_fetched runs exactly once per feed: once stopped, or if the multi
+// handle fails, the feeds still in flight or not started get an error.
+// Tests inject a failure of the multi handle by throwing from
+// before_perform, which runs before each step of the transfers.
+void FetchFeeds(const std::vector<FeedRequest>& requests, int max_transfers,
+                const std::function<void(size_t, FetchedFeed)>& on_fetched,
+                const std::function<bool()>& stop,
+                const TransferTimeouts& timeouts = {},
+                const std::function<void()>& before_perform = {});
+
+// The validators of each feed's last merged response, persisted in the data
+// directory so that the first refresh after a restart is conditional too.
+class FeedCache {
+ public:
+  // Starts empty if the file is missing or corrupt.
+  explicit FeedCache(std::filesystem::path path);
+
+  // Empty validators if the feed is unknown.
+  podcaster::FeedValidators Lookup(const std::string& feed_uri);
+
+  // Only marks the cache for saving if the validators changed.
+  void Store(const std::string& feed_uri,
+             const podcaster::FeedValidators& validators);
+
+  // Writes the cache if it changed since the last save.
+  bool Save();
+
+ private:
+  std::filesystem::path path_;
+
+  std::mutex mtx_;
+  podcaster::FeedCacheState cache_;
+  bool dirty_ = false;
+};
+
+}  // namespace podcaster
@@ -0,0 +1,396 @@
+#include "podcaster/feed_fetcher.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include <spdlog/fmt/fmt.h>
+
+#include "podcaster/test_utils.h"
+
+using podcaster::testing::TempDataDir;
+
+namespace {
+
+// "<rss>gzip</rss>" compressed with gzip
+constexpr unsigned char kGzipBody[] = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0xb3,
+    0x29, 0x2a, 0x2e, 0xb6, 0x4b, 0xaf, 0xca, 0x2c, 0xb0, 0xd1, 0x07,
+    0xb1, 0x00, 0x14, 0x94, 0xd7, 0x6c, 0x0f, 0x00, 0x00, 0x00};
+
+std::string Response(const std::string& status, const std::string& headers,
+                     const std::string& body) {
+  return fmt::format(
+      "HTTP/1.1 {}\r\nContent-Length: {}\r\nConnection: close\r\n{}\r\n{}",
+      status, body.size(), headers, body);
+}
+
+// Stands in for a feed host on a loopback port, answers each connection
+// with what the handler returns for the request head.
+class FakeHttpServer {
+ public:
+  using Handler = std::function<std::string(const std::string& request)>;
+
+  explicit FakeHttpServer(Handler handler) : handler_(std::move(handler)) {
+    fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    REQUIRE(bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+    REQUIRE(listen(fd_, 16) == 0);
+    socklen_t size = sizeof(addr);
+    getsockname(fd_, reinterpret_cast<sockaddr*>(&addr), &size);
+    port_ = ntohs(addr.sin_port);
+    thread_ = std::thread([this] { Serve(); });
+  }
+
+  ~FakeHttpServer() {
+    // wakes up the accept
+    shutdown(fd_, SHUT_RDWR);
+    thread_.join();
+    close(fd_);
+  }
+
+  std::string Uri(const std::string& path) const {
+    return fmt::format("http://127.0.0.1:{}{}", port_, path);
+  }
+
+  std::vector<std::string> Requests() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return requests_;
+  }
+
+ private:
+  void Serve() {
+    while (true) {
+      int client = accept(fd_, nullptr, nullptr);
+      if (client < 0) {
+        return;
+      }
+      std::string request;
+      char buffer[1024];
+      while (request.find("\r\n\r\n") == std::string::npos) {
+        auto size = read(client, buffer, sizeof(buffer));
+        if (size <= 0) {
+          break;
+        }
+        request.append(buffer, size);
+      }
+      {
+        std::lock_guard<std::mutex> lock(mtx_);
+        requests_.push_back(request);
+      }
+      // no assertions off the test thread, a short write fails the fetch;
+      // the client may hang up early without killing the test
+      auto response = handler_(request);
+      send(client, response.data(), response.size(), MSG_NOSIGNAL);
+      close(client);
+    }
+  }
+
+  Handler handler_;
+  int fd_ = -1;
+  int port_ = 0;
+  std::thread thread_;
+
+  std::mutex mtx_;
+  std::vector<std::string> requests_;
+};
+
+podcaster::FetchedFeed FetchOne(podcaster::FeedRequest request) {
+  podcaster::FetchedFeed result;
+  podcaster::FetchFeeds(
+      {std::move(request)}, 1,
+      [&](size_t index, podcaster::FetchedFeed fetched) {
+        REQUIRE(index == 0);
+        result = std::move(fetched);
+      },
+      [] { return false; });
+  return result;
+}
+
+}  // namespace
+
+TEST_CASE("Fetched feed carries its validators") {
+  FakeHttpServer server([](const std::string&) {
+    return Response("200 OK",
+                    "ETag: \"v1\"\r\n"
+                    "Last-Modified: Wed, 01 Jan 2025 00:00:00 GMT\r\n",
+                    "<rss/>");
+  });
+
+  auto fetched = FetchOne({server.Uri("/feed"), {}, {}});
+  REQUIRE(fetched.error.empty());
+  REQUIRE_FALSE(fetched.not_modified);
+  REQUIRE(fetched.body == "<rss/>");
+  REQUIRE(fetched.validators.etag() == "\"v1\"");
+  REQUIRE(fetched.validators.last_modified() ==
+          "Wed, 01 Jan 2025 00:00:00 GMT");
+  REQUIRE(fetched.validators.body_hash() != 0);
+
+  auto requests = server.Requests();
+  REQUIRE(requests.size() == 1);
+  REQUIRE(requests[0].find("Accept-Encoding: gzip") != std::string::npos);
+  REQUIRE(requests[0].find("If-None-Match") == std::string::npos);
+}
+
+TEST_CASE("Conditional fetch of an unchanged feed") {
+  FakeHttpServer server([](const std::string& request) {
+    if (request.find("If-None-Match: \"v1\"") != std::string::npos) {
+      return Response("304 Not Modified", "ETag: \"v1\"\r\n", "");
+    }
+    return Response("200 OK", "ETag: \"v2\"\r\n", "<rss/>");
+  });
+
+  podcaster::FeedRequest request{server.Uri("/feed"), {}, {}};
+  request.validators.set_etag("\"v1\"");
+  request.validators.set_last_modified("Wed, 01 Jan 2025 00:00:00 GMT");
+
+  auto fetched = FetchOne(request);
+  REQUIRE(fetched.error.empty());
+  REQUIRE(fetched.not_modified);
+  REQUIRE(fetched.body.empty());
+
+  auto requests = server.Requests();
+  REQUIRE(requests.size() == 1);
+  REQUIRE(requests[0].find(
+              "If-Modified-Since: Wed, 01 Jan 2025 00:00:00 GMT") !=
+          std::string::npos);
+
+  request.validators.set_etag("\"v0\"");
+  fetched = FetchOne(request);
+  REQUIRE_FALSE(fetched.not_modified);
+  REQUIRE(fetched.body == "<rss/>");
+  REQUIRE(fetched.validators.etag() == "\"v2\"");
+}
+
+TEST_CASE("Not modified feed keeps the validators the server rotated") {
+  FakeHttpServer server([](const std::string&) {
+    return Response("304 Not Modified", "ETag: \"v2\"\r\n", "");
+  });
+
+  podcaster::FeedRequest request{server.Uri("/feed"), {}, {}};
+  request.validators.set_etag("\"v1\"");
+  request.validators.set_last_modified("Wed, 01 Jan 2025 00:00:00 GMT");
+  request.validators.set_body_hash(42);
+
+  auto fetched = FetchOne(request);
+  REQUIRE(fetched.not_modified);
+  REQUIRE(fetched.validators.etag() == "\"v2\"");
+  REQUIRE(fetched.validators.last_modified() ==
+          "Wed, 01 Jan 2025 00:00:00 GMT");
+  REQUIRE(fetched.validators.body_hash() == 42);
+}
+
+TEST_CASE("Gzip encoded feed is decoded") {
+  FakeHttpServer server([](const std::string&) {
+    return Response(
+        "200 OK", "Content-Encoding: gzip\r\n",
+        std::string(reinterpret_cast<const char*>(kGzipBody),
+                    sizeof(kGzipBody)));
+  });
+
+  auto fetched = FetchOne({server.Uri("/feed"), {}, {}});
+  REQUIRE(fetched.error.empty());
+  REQUIRE(fetched.body == "<rss>gzip</rss>");
+
+  FakeHttpServer plain_server([](const std::string&) {
+    return Response("200 OK", "", "<rss>gzip</rss>");
+  });
+  auto plain = FetchOne({plain_server.Uri("/feed"), {}, {}});
+  REQUIRE(fetched.validators.body_hash() == plain.validators.body_hash());
+}
+
+TEST_CASE("Sink ends the transfer once it has enough") {
+  FakeHttpServer server([](const std::string& request) {
+    std::string tail(1 << 20, request.find("/a ") != std::string::npos
+                                  ? 'a'
+                                  : 'b');
+    return Response("200 OK", "", "<rss>same prefix</rss>" + tail);
+  });
+
+  auto fetch_prefix = [&](const std::string& path) {
+    std::string received;
+    podcaster::FeedRequest request{server.Uri(path), {}, {}};
+    request.sink = [&](std::string_view data) {
+      size_t wanted = std::min(data.size(), 22 - received.size());
+      received.append(data.substr(0, wanted));
+      return wanted;
+    };
+    auto fetched = FetchOne(request);
+    REQUIRE(fetched.error.empty());
+    REQUIRE(fetched.body.empty());
+    REQUIRE(received == "<rss>same prefix</rss>");
+    return fetched.validators.body_hash();
+  };
+
+  // only the consumed part of the body is hashed
+  REQUIRE(fetch_prefix("/a") == fetch_prefix("/b"));
+}
+
+TEST_CASE("Failed fetch reports the status") {
+  FakeHttpServer server([](const std::string&) {
+    return Response("404 Not Found", "", "missing");
+  });
+
+  auto fetched = FetchOne({server.Uri("/feed"), {}, {}});
+  REQUIRE(fetched.error == "Failed to download feed: HTTP 404");
+  REQUIRE(fetched.body.empty());
+}
+
+TEST_CASE("Stalled server fails the fetch") {
+  FakeHttpServer server([](const std::string&) {
+    std::this_thread::sleep_for(std::chrono::seconds(3));
+    return Response("200 OK", "", "<rss/>");
+  });
+
+  podcaster::TransferTimeouts timeouts;
+  timeouts.low_speed_time = std::chrono::seconds(1);
+  std::string error;
+  auto start = std::chrono::steady_clock::now();
+  podcaster::FetchFeeds(
+      {{server.Uri("/feed"), {}, {}}}, 1,
+      [&](size_t, podcaster::FetchedFeed fetched) { error = fetched.error; },
+      [] { return false; }, timeouts);
+  REQUIRE(error.find("Timeout") != std::string::npos);
+  REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::seconds(3));
+}
+
+TEST_CASE("Every feed is fetched once above the transfer cap") {
+  FakeHttpServer server([](const std::string& request) {
+    auto path_start = request.find(' ') + 1;
+    auto path = request.substr(path_start, request.find(' ', path_start) -
+                                               path_start);
+    return Response("200 OK", "", path);
+  });
+
+  std::vector<podcaster::FeedRequest> requests;
+  for (int i = 0; i < 5; i++) {
+    requests.push_back({server.Uri(fmt::format("/{}", i)), {}, {}});
+  }
+
+  std::map<size_t, std::string> bodies;
+  podcaster::FetchFeeds(
+      requests, 2,
+      [&](size_t index, podcaster::FetchedFeed fetched) {
+        REQUIRE(fetched.error.empty());
+        REQUIRE(bodies.emplace(index, fetched.body).second);
+      },
+      [] { return false; });
+
+  REQUIRE(bodies.size() == 5);
+  for (const auto& [index, body] : bodies) {
+    REQUIRE(body == fmt::format("/{}", index));
+  }
+}
+
+TEST_CASE("Stopped fetch skips the remaining feeds") {
+  FakeHttpServer server([](const std::string&) {
+    return Response("200 OK", "", "<rss/>");
+  });
+
+  std::vector<podcaster::FeedRequest> requests;
+  for (int i = 0; i < 5; i++) {
+    requests.push_back({server.Uri(fmt::format("/{}", i)), {}, {}});
+  }
+
+  int fetched = 0;
+  std::vector<size_t> skipped;
+  podcaster::FetchFeeds(
+      requests, 1,
+      [&](size_t index, podcaster::FetchedFeed result) {
+        if (result.error.empty()) {
+          fetched++;
+        } else {
+          REQUIRE(result.error == "Feed skipped, the refresh was stopped");
+          skipped.push_back(index);
+        }
+      },
+      [&] { return fetched > 0; });
+  REQUIRE(fetched == 1);
+  REQUIRE(skipped == std::vector<size_t>{1, 2, 3, 4});
+}
+
+TEST_CASE("Failed transfers report every feed") {
+  FakeHttpServer server([](const std::string&) {
+    return Response("200 OK", "", "<rss/>");
+  });
+
+  std::vector<podcaster::FeedRequest> requests;
+  for (int i = 0; i < 5; i++) {
+    requests.push_back({server.Uri(fmt::format("/{}", i)), {}, {}});
+  }
+
+  // fails once some feeds are in flight and others not started
+  int steps = 0;
+  std::map<size_t, std::string> errors;
+  podcaster::FetchFeeds(
+      requests, 2,
+      [&](size_t index, podcaster::FetchedFeed fetched) {
+        REQUIRE(errors.emplace(index, fetched.error).second);
+      },
+      [] { return false; }, {},
+      [&] {
+        if (++steps == 2) {
+          throw std::runtime_error("injected");
+        }
+      });
+
+  REQUIRE(errors.size() == 5);
+  for (const auto& [index, error] : errors) {
+    if (not error.empty()) {
+      REQUIRE(error == "Failed to download feed: injected");
+    }
+  }
+  REQUIRE(errors.at(4) == "Failed to download feed: injected");
+}
+
+TEST_CASE("Feed cache survives a restart") {
+  auto data_dir = TempDataDir("feed_cache");
+
+  podcaster::FeedValidators validators;
+  validators.set_etag("\"v1\"");
+  validators.set_body_hash(42);
+  {
+    podcaster::FeedCache cache(data_dir / "feed_cache.bin");
+    REQUIRE(cache.Lookup("pod1").etag().empty());
+    cache.Store("pod1", validators);
+    REQUIRE(cache.Save());
+  }
+
+  podcaster::FeedCache cache(data_dir / "feed_cache.bin");
+  REQUIRE(cache.Lookup("pod1").etag() == "\"v1\"");
+  REQUIRE(cache.Lookup("pod1").body_hash() == 42);
+  REQUIRE(cache.Lookup("pod2").body_hash() == 0);
+}
+
+TEST_CASE("Feed cache is only saved when the validators change") {
+  auto data_dir = TempDataDir("feed_cache_dirty");
+  auto path = data_dir / "feed_cache.bin";
+
+  podcaster::FeedValidators validators;
+  validators.set_etag("\"v1\"");
+  podcaster::FeedCache cache(path);
+  cache.Store("pod1", validators);
+  REQUIRE(cache.Save());
+  std::filesystem::remove(path);
+
+  cache.Store("pod1", validators);
+  REQUIRE(cache.Save());
+  REQUIRE_FALSE(std::filesystem::exists(path));
+
+  validators.set_etag("\"v2\"");
+  cache.Store("pod1", validators);
+  REQUIRE(cache.Save());
+  REQUIRE(podcaster::FeedCache(path).Lookup("pod1").etag() == "\"v2\"");
+}
@@ -0,0 +1,64 @@
+// SPDX-FileCopyrightText: 2025 Tomas Krupka
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "podcaster/file_utils.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <spdlog/spdlog.h>
+
+namespace file {
+
+bool WriteAll(int fd, std::string_view contents) {
+  while (not contents.empty()) {
+    ssize_t written = write(fd, contents.data(), contents.size());
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    contents.remove_prefix(written);
+  }
+  return true;
+}
+
+bool AtomicWrite(const std::filesystem::path& path, std::string_view contents) {
+  auto tmp_path = path;
+  tmp_path += ".tmp";
+
+  int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                0644);
+  if (fd < 0) {
+    spdlog::error("Failed to open {}: {}", tmp_path.string(),
+                  std::strerror(errno));
+    return false;
+  }
+
+  bool ok = WriteAll(fd, contents) and fsync(fd) == 0;
+  ok &= close(fd) == 0;
+  if (not ok) {
+    spdlog::error("Failed to write {}: {}", tmp_path.string(),
+                  std::strerror(errno));
+    return false;
+  }
+
+  if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+    spdlog::error("Failed to rename {}: {}", tmp_path.string(),
+                  std::strerror(errno));
+    return false;
+  }
+
+  // make the rename itself durable
+  int dir_fd = open(path.parent_path().c_str(), O_RDONLY | O_CLOEXEC);
+  if (dir_fd >= 0) {
+    fsync(dir_fd);
+    close(dir_fd);
+  }
+  return true;
+}
+
+}  // namespace file
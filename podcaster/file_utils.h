@@ -0,0 +1,19 @@
+// SPDX-FileCopyrightText: 2025 Tomas Krupka
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <filesystem>
+#include <string_view>
+
+namespace file {
+
+// Write all bytes to a file descriptor, retrying short writes.
+bool WriteAll(int fd, std::string_view contents);
+
+// Replace the file at path with contents. The data is written to a temporary
+// sibling, synced and renamed over the original, so a crash at any point
+// leaves either the old or the new file in place.
+bool AtomicWrite(const std::filesystem::path& path, std::string_view contents);
+
+}  // namespace file
@@ -0,0 +1,54 @@
+// SPDX-FileCopyrightText: 2025 Tomas Krupka
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+
+#include <spdlog/spdlog.h>
+
+namespace podcaster {
+
+// Time the render thread spends building frames, without the wait for
+// vsync. Stalls are logged right away, a summary every kReportInterval.
+class FrameStats {
+ public:
+  using Clock = std::chrono::steady_clock;
+  using Millis = std::chrono::duration<double, std::milli>;
+
+  static constexpr auto kStallThreshold = std::chrono::milliseconds(50);
+  static constexpr auto kReportInterval = std::chrono::seconds(10);
+
+  void BeginFrame() { frame_start_ = Clock::now(); }
+
+  void EndFrame() {
+    auto now = Clock::now();
+    auto frame_time = now - frame_start_;
+    if (frame_time > kStallThreshold) {
+      spdlog::warn("Frame stalled for {:.1f} ms", Millis(frame_time).count());
+    }
+    total_ += frame_time;
+    max_ = std::max(max_, frame_time);
+    num_frames_++;
+
+    if (now - report_start_ >= kReportInterval) {
+      spdlog::debug("{} frames, {:.2f} ms on average, {:.2f} ms at most",
+                    num_frames_, Millis(total_).count() / num_frames_,
+                    Millis(max_).count());
+      report_start_ = now;
+      total_ = {};
+      max_ = {};
+      num_frames_ = 0;
+    }
+  }
+
+ private:
+  Clock::time_point frame_start_;
+  Clock::time_point report_start_ = Clock::now();
+  Clock::duration total_ = {};
+  Clock::duration max_ = {};
+  int num_frames_ = 0;
+};
+
+}  // namespace podcaster
@@ -0,0 +1,24 @@
+// SPDX-FileCopyrightText: 2025 Tomas Krupka
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace fnv {
+
+constexpr uint64_t kOffset = 14695981039346656037ull;
+constexpr uint64_t kPrime = 1099511628211ull;
+
+// 64-bit FNV-1a. Unlike std::hash the value is the same on every platform
+// and toolchain, so it may be persisted. Data arriving in chunks is hashed
+// by passing the previous result as hash.
+constexpr uint64_t Hash(std::string_view data, uint64_t hash = kOffset) {
+  for (char c : data) {
+    hash = (hash ^ static_cast<unsigned char>(c)) * kPrime;
+  }
+  return hash;
+}
+
+}  // namespace fnv
@@ -0,0 +1,155 @@
+// SPDX-FileCopyrightText: 2025 Tomas Krupka
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "podcaster/journal.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/util/delimited_message_util.h>
+#include <spdlog/spdlog.h>
+
+#include "podcaster/file_utils.h"
+
+namespace podcaster {
+
+namespace {
+
+std::string Serialize(const std::vector<JournalEntry>::const_iterator& begin,
+                      const std::vector<JournalEntry>::const_iterator& end) {
+  std::string batch;
+  google::protobuf::io::StringOutputStream output_stream(&batch);
+  for (auto entry = begin; entry != end; ++entry) {
+    google::protobuf::util::SerializeDelimitedToZeroCopyStream(*entry,
+                                                               &output_stream);
+  }
+  return batch;
+}
+
+}  // namespace
+
+Journal::Journal(std::filesystem::path path) : path_(std::move(path)) {
+  Open();
+}
+
+Journal::~Journal() {
+  Flush();
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+int Journal::Replay(uint64_t snapshot_sequence,
+                    const std::function<void(const EpisodeUpdate&)>& apply) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  sequence_ = snapshot_sequence;
+  entries_.clear();
+  num_written_ = 0;
+
+  std::ifstream file(path_, std::ios::binary);
+  if (not file.is_open()) {
+    return 0;
+  }
+
+  google::protobuf::io::IstreamInputStream input_stream(&file);
+
+  int num_applied = 0;
+  int64_t valid_bytes = 0;
+  JournalEntry entry;
+  bool clean_eof = false;
+  while (google::protobuf::util::ParseDelimitedFromZeroCopyStream(
+      &entry, &input_stream, &clean_eof)) {
+    valid_bytes = input_stream.ByteCount();
+    if (entry.sequence() > sequence_) {
+      apply(entry.update());
+      num_applied++;
+      sequence_ = entry.sequence();
+      entries_.push_back(entry);
+    }
+  }
+  num_written_ = entries_.size();
+
+  if (not clean_eof) {
+    // torn write, cut it off so that new entries are readable
+    spdlog::warn("Journal {} ends with an incomplete entry", path_.string());
+    file.close();
+    std::filesystem::resize_file(path_, valid_bytes);
+  }
+
+  return num_applied;
+}
+
+uint64_t Journal::Append(const EpisodeUpdate& update) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto& entry = entries_.emplace_back();
+  entry.set_sequence(++sequence_);
+  *entry.mutable_update() = update;
+  return sequence_;
+}
+
+void Journal::Flush() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (num_written_ == entries_.size()) {
+    return;
+  }
+  if (Write(entries_.begin() + num_written_, entries_.end())) {
+    num_written_ = entries_.size();
+  }
+}
+
+void Journal::Truncate(uint64_t sequence) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  auto first_kept = std::find_if(
+      entries_.begin(), entries_.end(),
+      [sequence](const auto& entry) { return entry.sequence() > sequence; });
+  size_t num_dropped = std::distance(entries_.begin(), first_kept);
+
+  // entries newer than the snapshot may already be on disk, the file is
+  // replaced with them instead of truncated in place
+  auto kept = Serialize(entries_.begin() + std::min(num_dropped, num_written_),
+                        entries_.begin() + num_written_);
+  if (file::AtomicWrite(path_, kept)) {
+    // the descriptor still refers to the replaced file
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+    Open();
+  }
+
+  entries_.erase(entries_.begin(), first_kept);
+  num_written_ -= std::min(num_written_, num_dropped);
+}
+
+uint64_t Journal::Sequence() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return sequence_;
+}
+
+void Journal::Open() {
+  fd_ = open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    spdlog::error("Failed to open journal {}: {}", path_.string(),
+                  std::strerror(errno));
+  }
+}
+
+bool Journal::Write(const std::vector<JournalEntry>::const_iterator& begin,
+                    const std::vector<JournalEntry>::const_iterator& end) {
+  if (not file::WriteAll(fd_, Serialize(begin, end)) or
+      fdatasync(fd_) != 0) {
+    spdlog::error("Failed to write journal {}: {}", path_.string(),
+                  std::strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+}  // namespace podcaster
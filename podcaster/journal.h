@@ -0,0 +1,67 @@
+// SPDX-FileCopyrightText: 2025 Tomas Krupka
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "podcaster/message.pb.h"
+
+namespace podcaster {
+
+// Append-only log of persisted episode updates. Every entry carries a
+// sequence number, snapshots record the last sequence they include, so
+// replaying the journal over a snapshot is safe even if the journal was
+// not truncated after the snapshot was written.
+//
+// Appending only buffers the entry, Flush writes everything buffered so far
+// with a single write and sync. Entries are kept in memory until a snapshot
+// covers them, the journal is compacted long before that gets expensive.
+class Journal {
+ public:
+  explicit Journal(std::filesystem::path path);
+  ~Journal();
+
+  Journal(const Journal&) = delete;
+  Journal& operator=(const Journal&) = delete;
+  Journal(Journal&&) = delete;
+  Journal& operator=(Journal&&) = delete;
+
+  // Calls apply for every entry newer than snapshot_sequence, stops at the
+  // first incomplete entry. Returns the number of entries applied.
+  int Replay(uint64_t snapshot_sequence,
+             const std::function<void(const EpisodeUpdate&)>& apply);
+
+  // Buffers the entry, returns its sequence number.
+  uint64_t Append(const EpisodeUpdate& update);
+
+  // Writes all buffered entries to disk.
+  void Flush();
+
+  // Drop entries up to and including sequence, they are part of a snapshot.
+  // The entries kept replace the file atomically, so a crash never loses
+  // entries already on disk.
+  void Truncate(uint64_t sequence);
+
+  uint64_t Sequence() const;
+
+ private:
+  void Open();
+
+  bool Write(const std::vector<JournalEntry>::const_iterator& begin,
+             const std::vector<JournalEntry>::const_iterator& end);
+
+  std::filesystem::path path_;
+  int fd_ = -1;
+
+  mutable std::mutex mutex_;
+  std::vector<JournalEntry> entries_;
+  size_t num_written_ = 0;
+  uint64_t sequence_ = 0;
+};
+
+}  // namespace podcaster
@@ -13,6 +13,8 @@
 #include <SDL_keycode.h>
 #include <spdlog/spdlog.h>
 
+#include "podcaster/database_utils.h"
+#include "podcaster/frame_stats.h"
 #include "podcaster/imgui_utils.h"
 #include "podcaster/podcaster_gui.h"
 #include "podcaster/sdl_utils.h"
@@ -28,7 +30,7 @@ const std::string kTargetDriver = "mali";
 const std::string kTargetDriver = "wayland";
 #endif
 
-int main(int /*unused*/, char** /*unused*/) {
+int main(int argc, char** argv) {
   SDL_SetHint(SDL_HINT_GAMECONTROLLERCONFIG_FILE,
               kControllerDatabasePath.c_str());
 
@@ -61,15 +63,23 @@ int main(int /*unused*/, char** /*unused*/) {
 #endif
 
   // gui
+  // the daemon's data directory or any gRPC address, by default the daemon
+  // shares the storage path with the client
+  std::string server_address =
+      argc > 1 ? podcaster::utils::ServerAddress(argv[1])
+               : podcaster::utils::SocketAddress(storage_path);
+  spdlog::info("Connecting to {}", server_address);
   podcaster::PodcasterClient podcaster_client(grpc::CreateChannel(
-      "localhost:50051", grpc::InsecureChannelCredentials()));
+      server_address, grpc::InsecureChannelCredentials()));
   podcaster::PodcasterGui podcaster_gui{std::move(podcaster_client), exe_path};
 
   // event loop
   SDL_Event event;
   bool quit = false;
+  podcaster::FrameStats frame_stats;
 
   while (!quit) {
+    frame_stats.BeginFrame();
     podcaster::Action action = {podcaster::ActionType::kIdle};
 
     while (SDL_PollEvent(&event) > 0) {
@@ -123,6 +133,7 @@ int main(int /*unused*/, char** /*unused*/) {
 
     imgui::Render([&]() { podcaster_gui.Run(action); },
                   window_ctx.renderer.get());
+    frame_stats.EndFrame();
 
     SDL_RenderPresent(window_ctx.renderer.get());
   }
@@ -0,0 +1,170 @@
+// SPDX-FileCopyrightText: 2025 Tomas Krupka
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "podcaster/metrics.h"
+
+#include <algorithm>
+
+#include <spdlog/fmt/fmt.h>
+
+namespace podcaster {
+
+Histogram::Histogram(std::vector<double> bounds)
+    : bounds_(std::move(bounds)),
+      counts_(std::make_unique<std::atomic<uint64_t>[]>(bounds_.size() + 1)) {}
+
+std::vector<double> Histogram::LatencyBounds() {
+  return {0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1, 5, 10, 30};
+}
+
+void Histogram::Observe(double value) {
+  auto bucket = std::lower_bound(bounds_.begin(), bounds_.end(), value) -
+                bounds_.begin();
+  counts_[bucket].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(value, std::memory_order_relaxed);
+}
+
+void Histogram::ObserveSince(Clock::time_point start) {
+  Observe(std::chrono::duration<double>(Clock::now() - start).count());
+}
+
+HistogramValue Histogram::Value() const {
+  HistogramValue value;
+  for (size_t i = 0; i < bounds_.size(); i++) {
+    value.add_bounds(bounds_[i]);
+    value.add_counts(counts_[i].load(std::memory_order_relaxed));
+  }
+  value.add_counts(counts_[bounds_.size()].load(std::memory_order_relaxed));
+  value.set_count(count_.load(std::memory_order_relaxed));
+  value.set_sum(sum_.load(std::memory_order_relaxed));
+  return value;
+}
+
+namespace {
+
+Metric* NewMetric(const std::string& name, const MetricLabels& labels,
+                  Metrics* metrics) {
+  auto* metric = metrics->add_metrics();
+  metric->set_name(name);
+  for (const auto& [label, value] : labels) {
+    auto* metric_label = metric->add_labels();
+    metric_label->set_name(label);
+    metric_label->set_value(value);
+  }
+  return metric;
+}
+
+std::string EscapeLabelValue(const std::string& value) {
+  std::string escaped;
+  for (char c : value) {
+    switch (c) {
+      case '\\':
+        escaped += "\\\\";
+        break;
+      case '"':
+        escaped += "\\\"";
+        break;
+      case '\n':
+        escaped += "\\n";
+        break;
+      default:
+        escaped += c;
+    }
+  }
+  return escaped;
+}
+
+// {a="1",b="2"}, extra is appended as the last label if not empty.
+std::string LabelText(const Metric& metric, const std::string& extra = "") {
+  std::string labels;
+  for (const auto& label : metric.labels()) {
+    labels += fmt::format("{}{}=\"{}\"", labels.empty() ? "" : ",",
+                          label.name(), EscapeLabelValue(label.value()));
+  }
+  if (not extra.empty()) {
+    labels += fmt::format("{}{}", labels.empty() ? "" : ",", extra);
+  }
+  if (labels.empty()) {
+    return "";
+  }
+  return fmt::format("{{{}}}", labels);
+}
+
+const char* TypeName(const Metric& metric) {
+  switch (metric.value_case()) {
+    case Metric::kCounter:
+      return "counter";
+    case Metric::kHistogram:
+      return "histogram";
+    default:
+      return "gauge";
+  }
+}
+
+}  // namespace
+
+void AddCounter(const std::string& name, const MetricLabels& labels,
+                uint64_t value, Metrics* metrics) {
+  NewMetric(name, labels, metrics)->set_counter(value);
+}
+
+void AddMetric(const std::string& name, const MetricLabels& labels,
+               const Counter& counter, Metrics* metrics) {
+  AddCounter(name, labels, counter.Value(), metrics);
+}
+
+void AddMetric(const std::string& name, const MetricLabels& labels,
+               const Gauge& gauge, Metrics* metrics) {
+  NewMetric(name, labels, metrics)->set_gauge(gauge.Value());
+}
+
+void AddMetric(const std::string& name, const MetricLabels& labels,
+               const Histogram& histogram, Metrics* metrics) {
+  *NewMetric(name, labels, metrics)->mutable_histogram() = histogram.Value();
+}
+
+std::string PrometheusText(const Metrics& metrics) {
+  std::string text;
+  const std::string* last_name = nullptr;
+  for (const auto& metric : metrics.metrics()) {
+    if (not last_name or *last_name != metric.name()) {
+      text += fmt::format("# TYPE {} {}\n", metric.name(), TypeName(metric));
+      last_name = &metric.name();
+    }
+    switch (metric.value_case()) {
+      case Metric::kCounter:
+        text += fmt::format("{}{} {}\n", metric.name(), LabelText(metric),
+                            metric.counter());
+        break;
+      case Metric::kGauge:
+        text += fmt::format("{}{} {}\n", metric.name(), LabelText(metric),
+                            metric.gauge());
+        break;
+      case Metric::kHistogram: {
+        const auto& histogram = metric.histogram();
+        // Prometheus buckets count everything up to their bound
+        uint64_t cumulative = 0;
+        for (int i = 0; i < histogram.counts_size(); i++) {
+          cumulative += histogram.counts(i);
+          std::string bound = i < histogram.bounds_size()
+                                  ? fmt::format("{}", histogram.bounds(i))
+                                  : "+Inf";
+          text += fmt::format(
+              "{}_bucket{} {}\n", metric.name(),
+              LabelText(metric, fmt::format("le=\"{}\"", bound)), cumulative);
+        }
+        text += fmt::format("{}_sum{} {}\n", metric.name(), LabelText(metric),
+                            histogram.sum());
+        text += fmt::format("{}_count{} {}\n", metric.name(),
+                            LabelText(metric), histogram.count());
+        break;
+      }
+      default:
+        break;
+    }
+  }
+  return text;
+}
+
+}  // namespace podcaster
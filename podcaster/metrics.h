@@ -0,0 +1,146 @@
+// SPDX-FileCopyrightText: 2025 Tomas Krupka
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "podcaster/message.pb.h"
+
+namespace podcaster {
+
+// Metric primitives are updated with relaxed atomics, instrumenting a hot
+// path never takes a lock. Values are read when the metrics are exported.
+
+class Counter {
+ public:
+  void Add(uint64_t n = 1) { value_.fetch_add(n, std::memory_order_relaxed); }
+
+  uint64_t Value() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<uint64_t> value_ = 0;
+};
+
+class Gauge {
+ public:
+  void Set(int64_t value) { value_.store(value, std::memory_order_relaxed); }
+
+  void Add(int64_t n) { value_.fetch_add(n, std::memory_order_relaxed); }
+
+  int64_t Value() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<int64_t> value_ = 0;
+};
+
+// Counts observations in buckets fixed at construction.
+class Histogram {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  // Upper bounds in ascending order, larger values go to an extra bucket.
+  explicit Histogram(std::vector<double> bounds);
+
+  // Seconds, from 1 ms to 30 s.
+  static std::vector<double> LatencyBounds();
+
+  void Observe(double value);
+
+  // Observes the seconds passed since start.
+  void ObserveSince(Clock::time_point start);
+
+  HistogramValue Value() const;
+
+ private:
+  const std::vector<double> bounds_;
+  std::unique_ptr<std::atomic<uint64_t>[]> counts_;
+  std::atomic<uint64_t> count_ = 0;
+  std::atomic<double> sum_ = 0;
+};
+
+// Series of one metric by the value of a single label, e.g. per feed. Only
+// finding a series takes a lock, look it up once per operation rather than
+// per update. A series is shared with its callers, so it may be dropped from
+// the family while one still updates it.
+template <typename T>
+class Family {
+ public:
+  explicit Family(std::string label)
+      : Family(std::move(label), [] { return std::make_unique<T>(); }) {}
+
+  Family(std::string label, std::function<std::unique_ptr<T>()> make)
+      : label_(std::move(label)), make_(std::move(make)) {}
+
+  std::shared_ptr<T> With(const std::string& label_value) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto& series = series_[label_value];
+    if (not series) {
+      series = make_();
+    }
+    return series;
+  }
+
+  // Drops the series whose label value keep rejects, e.g. of feeds no
+  // longer in the config.
+  void Retain(const std::function<bool(const std::string&)>& keep) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    std::erase_if(series_,
+                  [&](const auto& series) { return not keep(series.first); });
+  }
+
+  const std::string& Label() const { return label_; }
+
+  void ForEach(
+      const std::function<void(const std::string&, const T&)>& func) const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (const auto& [label_value, series] : series_) {
+      func(label_value, *series);
+    }
+  }
+
+ private:
+  const std::string label_;
+  const std::function<std::unique_ptr<T>()> make_;
+
+  mutable std::mutex mtx_;
+  std::map<std::string, std::shared_ptr<T>> series_;
+};
+
+using MetricLabels = std::vector<std::pair<std::string, std::string>>;
+
+void AddCounter(const std::string& name, const MetricLabels& labels,
+                uint64_t value, Metrics* metrics);
+
+void AddMetric(const std::string& name, const MetricLabels& labels,
+               const Counter& counter, Metrics* metrics);
+
+void AddMetric(const std::string& name, const MetricLabels& labels,
+               const Gauge& gauge, Metrics* metrics);
+
+void AddMetric(const std::string& name, const MetricLabels& labels,
+               const Histogram& histogram, Metrics* metrics);
+
+// One metric per series of the family.
+template <typename T>
+void AddMetric(const std::string& name, const Family<T>& family,
+               Metrics* metrics) {
+  family.ForEach([&](const std::string& label_value, const T& series) {
+    AddMetric(name, {{family.Label(), label_value}}, series, metrics);
+  });
+}
+
+// Prometheus text exposition format, metrics of the same name are expected
+// to be adjacent.
+std::string PrometheusText(const Metrics& metrics);
+
+}  // namespace podcaster
@@ -0,0 +1,78 @@
+#include "podcaster/metrics.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+TEST_CASE("Histogram counts values per bucket") {
+  podcaster::Histogram histogram({1, 10});
+  histogram.Observe(0.5);
+  histogram.Observe(1);
+  histogram.Observe(5);
+  histogram.Observe(50);
+
+  auto value = histogram.Value();
+  REQUIRE(value.bounds_size() == 2);
+  REQUIRE(value.counts_size() == 3);
+  // a bound is part of its bucket
+  REQUIRE(value.counts(0) == 2);
+  REQUIRE(value.counts(1) == 1);
+  REQUIRE(value.counts(2) == 1);
+  REQUIRE(value.count() == 4);
+  REQUIRE(value.sum() == 56.5);
+}
+
+TEST_CASE("Family keeps one series per label value") {
+  podcaster::Family<podcaster::Counter> family("feed");
+  family.With("a")->Add();
+  family.With("b")->Add(2);
+  family.With("a")->Add();
+
+  podcaster::Metrics metrics;
+  podcaster::AddMetric("fetches", family, &metrics);
+  REQUIRE(metrics.metrics_size() == 2);
+  REQUIRE(metrics.metrics(0).labels(0).name() == "feed");
+  REQUIRE(metrics.metrics(0).labels(0).value() == "a");
+  REQUIRE(metrics.metrics(0).counter() == 2);
+  REQUIRE(metrics.metrics(1).counter() == 2);
+}
+
+TEST_CASE("Family drops the series it doesn't retain") {
+  podcaster::Family<podcaster::Counter> family("feed");
+  family.With("a")->Add();
+  auto dropped = family.With("b");
+
+  family.Retain([](const std::string& feed) { return feed == "a"; });
+  // still safe to update
+  dropped->Add();
+
+  podcaster::Metrics metrics;
+  podcaster::AddMetric("fetches", family, &metrics);
+  REQUIRE(metrics.metrics_size() == 1);
+  REQUIRE(metrics.metrics(0).labels(0).value() == "a");
+}
+
+TEST_CASE("Prometheus text format") {
+  podcaster::Counter counter;
+  counter.Add(3);
+  podcaster::Gauge gauge;
+  gauge.Set(-1);
+  podcaster::Histogram histogram({0.5});
+  histogram.Observe(0.25);
+  histogram.Observe(2);
+
+  podcaster::Metrics metrics;
+  podcaster::AddMetric("requests_total", {}, counter, &metrics);
+  podcaster::AddMetric("depth", {{"feed", "say \"hi\""}}, gauge, &metrics);
+  podcaster::AddMetric("latency_seconds", {{"rpc", "State"}}, histogram,
+                       &metrics);
+
+  REQUIRE(podcaster::PrometheusText(metrics) ==
+          "# TYPE requests_total counter\n"
+          "requests_total 3\n"
+          "# TYPE depth gauge\n"
+          "depth{feed=\"say \\\"hi\\\"\"} -1\n"
+          "# TYPE latency_seconds histogram\n"
+          "latency_seconds_bucket{rpc=\"State\",le=\"0.5\"} 1\n"
+          "latency_seconds_bucket{rpc=\"State\",le=\"+Inf\"} 2\n"
+          "latency_seconds_sum{rpc=\"State\"} 2.25\n"
+          "latency_seconds_count{rpc=\"State\"} 2\n");
+}
@@ -7,6 +7,7 @@
 
 #include <curlpp/cURLpp.hpp>
 #include <grpcpp/grpcpp.h>
+#include <grpcpp/resource_quota.h>
 #include <SDL_mixer.h>
 
 #include "podcaster/podcaster_impl.h"
@@ -34,20 +35,42 @@ int main(int argc, char** argv) {
   sdl::SDLMixerContext sdl_mixer_ctx = sdl::InitMix();
   RegisterInterruptHandler(CancelHandler);
 
+  if (argc < 2) {
+    spdlog::error("Usage: {} DATA_DIR [ADDRESS]", argv[0]);
+    return 1;
+  }
   std::filesystem::path data_dir = argv[1];
   if (!data_dir.is_absolute()) {
     throw std::runtime_error("Data directory must be an absolute path.");
   }
 
-  std::string server_address("0.0.0.0:50051");
-  podcaster::PodcasterImpl service(data_dir, [&] { CancelHandler(0); });
+  // e.g. "0.0.0.0:50051" to serve over TCP instead
+  std::string server_address = argc > 2
+                                   ? podcaster::utils::ServerAddress(argv[2])
+                                   : podcaster::utils::SocketAddress(data_dir);
+  auto limits = podcaster::ServerLimits(podcaster::LoadConfig(data_dir));
+  podcaster::PodcasterImpl service(data_dir, limits,
+                                   [&] { CancelHandler(0); });
+
+  grpc::ResourceQuota quota("podcasterd");
+  quota.SetMaxThreads(limits.max_grpc_threads());
+  if (limits.memory_quota_mb() > 0) {
+    quota.Resize(static_cast<size_t>(limits.memory_quota_mb()) * 1024 * 1024);
+  }
 
   grpc::ServerBuilder builder;
+  builder.SetResourceQuota(quota);
   builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
   builder.RegisterService(&service);
   std::unique_ptr<grpc::Server> server(builder.BuildAndStart());
-  spdlog::info("Server listening on {}", server_address);
+  if (!server) {
+    spdlog::error("Failed to listen on {}", server_address);
+    return 1;
+  }
+  spdlog::info("Server listening on {}, {} worker threads", server_address,
+               limits.worker_threads());
 
   cancel_service.wait(0);
+  service.StopUpdateStreams();
   server->Shutdown();
 }
\ No newline at end of file
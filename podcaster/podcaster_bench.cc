@@ -0,0 +1,658 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <thread>
+#include <utility>
+
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <google/protobuf/arena.h>
+#include <grpcpp/grpcpp.h>
+#include <pugixml.hpp>
+#include <spdlog/fmt/fmt.h>
+
+#include "podcaster/client_worker.h"
+#include "podcaster/database.h"
+#include "podcaster/database_utils.h"
+#include "podcaster/frame_stats.h"
+#include "podcaster/podcaster_impl.h"
+#include "podcaster/rss_parser.h"
+#include "podcaster/thread_pool.h"
+
+// count heap allocations, reported by the "Allocations" test case
+std::atomic<uint64_t> num_allocations = 0;
+
+void* operator new(std::size_t size) {
+  num_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+
+void operator delete(void* ptr, std::size_t size) noexcept { std::free(ptr); }
+
+namespace {
+
+constexpr int kEpisodesPerPodcast = 100;
+constexpr int kDatabaseSizes[] = {100, 1000, 10000};
+// items of the synthetic feeds, the largest is about 10 MB
+constexpr int kFeedSizes[] = {100, 7500};
+constexpr size_t kMaxFeedItems = 10;
+// typical size of a curl write callback
+constexpr size_t kFeedChunkSize = 16 * 1024;
+
+std::filesystem::path TempDataDir(const std::string& name) {
+  auto path = std::filesystem::temp_directory_path() / "podcaster_bench" / name;
+  std::filesystem::remove_all(path);
+  std::filesystem::create_directories(path);
+  return path;
+}
+
+// Description shaped like a typical RSS item: paragraphs with links.
+std::string MakeDescription(int id) {
+  std::string description;
+  for (int p = 0; p < 5; p++) {
+    description += fmt::format(
+        "<p>Paragraph {} of episode {}, with a <a "
+        "href=\"https://example.com/{}/{}\">link</a> and <strong>some "
+        "emphasis</strong>.<br>Lorem ipsum dolor sit amet, consectetur "
+        "adipiscing elit, sed do eiusmod tempor incididunt ut labore.</p>",
+        p, id, id, p);
+  }
+  return description;
+}
+
+podcaster::Podcast MakePodcast(int podcast_id, int num_episodes) {
+  podcaster::Podcast podcast;
+  podcast.set_podcast_uri(
+      fmt::format("https://example.com/feed/{:04}.xml", podcast_id));
+  podcast.set_title(fmt::format("Podcast {}", podcast_id));
+  for (int i = 0; i < num_episodes; i++) {
+    auto* episode = podcast.add_episodes();
+    episode->set_episode_uri(
+        fmt::format("https://cdn.example.com/audio/{:04}/episode-{:04}.mp3",
+                    podcast_id, i));
+    episode->set_title(fmt::format("Episode {}", i));
+    episode->set_description_short(
+        fmt::format("Short description of episode {}", i));
+  }
+  return podcast;
+}
+
+// Synthetic database with num_episodes split into podcasts of 100 episodes.
+std::vector<podcaster::Podcast> MakePodcasts(int num_episodes) {
+  std::vector<podcaster::Podcast> podcasts;
+  for (int p = 0; p * kEpisodesPerPodcast < num_episodes; p++) {
+    int remaining = num_episodes - p * kEpisodesPerPodcast;
+    podcasts.push_back(
+        MakePodcast(p, std::min(kEpisodesPerPodcast, remaining)));
+  }
+  return podcasts;
+}
+
+podcaster::DatabaseState MakeState(int num_episodes) {
+  podcaster::DatabaseState state;
+  for (auto& podcast : MakePodcasts(num_episodes)) {
+    *state.add_podcasts() = std::move(podcast);
+  }
+  return state;
+}
+
+std::vector<podcaster::EpisodeUri> AllEpisodes(
+    const podcaster::DatabaseState& state) {
+  std::vector<podcaster::EpisodeUri> uris;
+  for (const auto& podcast : state.podcasts()) {
+    for (const auto& episode : podcast.episodes()) {
+      auto& uri = uris.emplace_back();
+      uri.set_podcast_uri(podcast.podcast_uri());
+      uri.set_episode_uri(episode.episode_uri());
+    }
+  }
+  return uris;
+}
+
+// The merge SavePodcast used to do: linear lookup and MergeFrom per episode.
+void LinearMerge(const podcaster::Podcast& updated_podcast,
+                 podcaster::Podcast* podcast) {
+  for (const auto& updated_episode : updated_podcast.episodes()) {
+    auto episode = std::find_if(podcast->mutable_episodes()->begin(),
+                                podcast->mutable_episodes()->end(),
+                                [&](const podcaster::Episode& episode) {
+                                  return episode.episode_uri() ==
+                                         updated_episode.episode_uri();
+                                });
+    if (episode != podcast->mutable_episodes()->end()) {
+      episode->MergeFrom(updated_episode);
+    } else {
+      podcast->add_episodes()->CopyFrom(updated_episode);
+    }
+  }
+}
+
+// RSS document with num_items items, the newest first.
+std::string MakeFeed(int num_items) {
+  std::string feed =
+      "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+      "<rss version=\"2.0\"><channel><title>Synthetic feed</title>\n";
+  for (int i = num_items - 1; i >= 0; i--) {
+    feed += fmt::format(
+        "<item><title>Episode {}</title>"
+        "<description><![CDATA[{}]]></description>"
+        "<enclosure url=\"https://cdn.example.com/audio/episode-{:05}.mp3\" "
+        "type=\"audio/mpeg\"/></item>\n",
+        i, MakeDescription(i), i);
+  }
+  feed += "</channel></rss>\n";
+  return feed;
+}
+
+// The feed parse before RssStreamParser: the whole document, the items
+// selected and sorted with XPath, then XPath again for each item kept.
+size_t ParseWithXPath(const std::string& body) {
+  pugi::xml_document doc;
+  doc.load_buffer(body.data(), body.size());
+  auto title = doc.select_node("/rss/channel/title").node();
+  auto episodes = doc.select_nodes("/rss/channel/item");
+  episodes.sort(true);
+
+  size_t size = std::string_view(title.text().as_string()).size();
+  const auto* first =
+      std::max(episodes.begin(), episodes.end() - kMaxFeedItems);
+  for (const auto* iter = first; iter != episodes.end(); iter++) {
+    auto node = iter->node();
+    auto title = node.select_node("title").node();
+    auto description = node.select_node("description").node();
+    auto audio_uri = node.select_node("enclosure").node().attribute("url");
+    size += std::string_view(title.text().as_string()).size() +
+            std::string_view(description.text().as_string()).size() +
+            std::string_view(audio_uri.as_string()).size();
+  }
+  return size;
+}
+
+// Fed in chunks like the fetcher does, stopping when the parser has enough.
+size_t ParseStreaming(std::string_view body) {
+  podcaster::RssStreamParser parser(kMaxFeedItems);
+  for (size_t pos = 0; pos < body.size(); pos += kFeedChunkSize) {
+    auto chunk = body.substr(pos, kFeedChunkSize);
+    if (parser.Feed(chunk) < chunk.size()) {
+      break;
+    }
+  }
+  std::string error;
+  parser.Finish(&error);
+
+  const auto& feed = parser.Result();
+  size_t size = feed.title.size();
+  for (const auto& item : feed.items) {
+    size += item.title.size() + item.description.size() +
+            item.enclosure_url.size();
+  }
+  return size;
+}
+
+// The synthetic feeds, and any *.xml in PODCASTER_FEED_CORPUS.
+std::vector<std::pair<std::string, std::string>> FeedCorpus() {
+  std::vector<std::pair<std::string, std::string>> corpus;
+  for (int num_items : kFeedSizes) {
+    corpus.emplace_back(fmt::format("{} items", num_items),
+                        MakeFeed(num_items));
+  }
+  if (const char* dir = std::getenv("PODCASTER_FEED_CORPUS")) {
+    for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+      if (entry.path().extension() != ".xml") {
+        continue;
+      }
+      std::ifstream file(entry.path(), std::ios::binary);
+      corpus.emplace_back(entry.path().filename().string(),
+                          std::string(std::istreambuf_iterator<char>(file),
+                                      std::istreambuf_iterator<char>()));
+    }
+  }
+  return corpus;
+}
+
+// Playback progress update of the first episode, invalidates snapshots.
+podcaster::EpisodeUpdate MakeUpdate(const podcaster::Podcast& podcast) {
+  podcaster::EpisodeUpdate update;
+  update.mutable_uri()->set_podcast_uri(podcast.podcast_uri());
+  update.mutable_uri()->set_episode_uri(podcast.episodes(0).episode_uri());
+  update.set_new_playback_progress(1000);
+  return update;
+}
+
+template <typename Func>
+uint64_t CountAllocations(Func&& func) {
+  uint64_t before = num_allocations.load();
+  func();
+  return num_allocations.load() - before;
+}
+
+}  // namespace
+
+TEST_CASE("Parse description") {
+  auto description = MakeDescription(0);
+  BENCHMARK("parse description") {
+    return podcaster::ParseDescription(description);
+  };
+
+  podcaster::DescriptionCache cache(TempDataDir("description_cache") /
+                                    "description_cache.bin");
+  cache.Store("feed", description, podcaster::ParseDescription(description));
+  BENCHMARK("cached description") {
+    return cache.Lookup("feed", description);
+  };
+}
+
+// A refresh's worth of new descriptions, the calling thread is one of the
+// parse threads.
+TEST_CASE("Parse descriptions") {
+  std::vector<std::string> descriptions;
+  for (int i = 0; i < 10; i++) {
+    descriptions.push_back(MakeDescription(i));
+  }
+  std::vector<podcaster::ParsedDescription> parsed(descriptions.size());
+  auto parse = [&](size_t i) {
+    parsed[i] = podcaster::ParseDescription(descriptions[i]);
+  };
+
+  BENCHMARK("10 descriptions, 1 thread") {
+    for (size_t i = 0; i < descriptions.size(); i++) {
+      parse(i);
+    }
+  };
+  for (int num_threads : {2, 4}) {
+    podcaster::ThreadPool pool(num_threads - 1);
+    BENCHMARK(fmt::format("10 descriptions, {} threads", num_threads)) {
+      pool.ParallelFor(descriptions.size(), parse);
+    };
+  }
+}
+
+// Without the descriptions, which cost the same either way.
+TEST_CASE("Parse feed") {
+  for (const auto& [name, body] : FeedCorpus()) {
+    REQUIRE(ParseStreaming(body) == ParseWithXPath(body));
+
+    BENCHMARK(fmt::format("document and XPath, {}, {} KB", name,
+                          body.size() / 1024)) {
+      return ParseWithXPath(body);
+    };
+    BENCHMARK(fmt::format("stream, {}, {} KB", name, body.size() / 1024)) {
+      return ParseStreaming(body);
+    };
+  }
+}
+
+TEST_CASE("Download filename") {
+  std::string podcast_uri = "https://example.com/feed/0000.xml";
+  std::string episode_uri =
+      "https://cdn.example.com/audio/0000/episode-0000.mp3?player=podcaster";
+  BENCHMARK("download filename") {
+    return podcaster::DownloadFilename(podcast_uri, episode_uri);
+  };
+}
+
+TEST_CASE("Apply update") {
+  for (int num_episodes : kDatabaseSizes) {
+    auto state = MakeState(num_episodes);
+    auto uris = AllEpisodes(state);
+
+    podcaster::EpisodeUpdate update;
+    update.set_new_playback_progress(1000);
+
+    // cycle through all episodes, the average case for the linear scan
+    int next = 0;
+    BENCHMARK(fmt::format("utils::ApplyUpdate, {} episodes", num_episodes)) {
+      *update.mutable_uri() = uris[next++ % uris.size()];
+      podcaster::utils::ApplyUpdate(update, &state);
+    };
+  }
+}
+
+TEST_CASE("Episode lookup, 10k episodes") {
+  podcaster::Database db(TempDataDir("lookup"));
+  for (auto& podcast : MakePodcasts(10000)) {
+    db.SavePodcast(std::move(podcast));
+  }
+  auto state = db.GetState();
+
+  // worst case for the linear scan: last episode of the last podcast
+  const auto& last_podcast = state.podcasts(state.podcasts_size() - 1);
+  podcaster::EpisodeUri uri;
+  uri.set_podcast_uri(last_podcast.podcast_uri());
+  uri.set_episode_uri(
+      last_podcast.episodes(last_podcast.episodes_size() - 1).episode_uri());
+
+  podcaster::EpisodeUpdate update;
+  update.mutable_uri()->CopyFrom(uri);
+  update.set_new_playback_progress(1000);
+
+  BENCHMARK("linear scan") {
+    return podcaster::utils::FindEpisodeMutable(uri, &state).has_value();
+  };
+
+  BENCHMARK("index") { return db.FindEpisodeMutable(uri) != nullptr; };
+
+  BENCHMARK("apply update, linear scan") {
+    podcaster::utils::ApplyUpdate(update, &state);
+  };
+
+  BENCHMARK("apply update, index") { db.ApplyUpdate(update); };
+}
+
+TEST_CASE("Save podcast") {
+  for (int num_episodes : kDatabaseSizes) {
+    auto podcasts = MakePodcasts(num_episodes);
+
+    BENCHMARK_ADVANCED(fmt::format("new database, {} episodes", num_episodes))
+    (Catch::Benchmark::Chronometer meter) {
+      std::vector<std::unique_ptr<podcaster::Database>> dbs;
+      for (int i = 0; i < meter.runs(); i++) {
+        dbs.push_back(std::make_unique<podcaster::Database>(
+            TempDataDir(fmt::format("save_podcast_{}", i))));
+      }
+      meter.measure([&](int i) {
+        for (const auto& podcast : podcasts) {
+          dbs[i]->SavePodcast(podcast);
+        }
+      });
+    };
+
+    podcaster::Database db(TempDataDir("refresh"));
+    for (const auto& podcast : podcasts) {
+      db.SavePodcast(podcast);
+    }
+    BENCHMARK(fmt::format("unchanged refresh, {} episodes", num_episodes)) {
+      for (const auto& podcast : podcasts) {
+        db.SavePodcast(podcast);
+      }
+    };
+  }
+}
+
+TEST_CASE("Snapshot") {
+  for (int num_episodes : kDatabaseSizes) {
+    podcaster::Database db(TempDataDir("snapshot"));
+    auto podcasts = MakePodcasts(num_episodes);
+    for (const auto& podcast : podcasts) {
+      db.SavePodcast(podcast);
+    }
+    auto update = MakeUpdate(podcasts.front());
+
+    BENCHMARK(fmt::format("heap copy, {} episodes", num_episodes)) {
+      return std::make_shared<const podcaster::DatabaseState>(db.GetState());
+    };
+
+    BENCHMARK(fmt::format("arena copy, {} episodes", num_episodes)) {
+      db.ApplyUpdate(update);
+      return db.Snapshot();
+    };
+  }
+}
+
+TEST_CASE("Feed merge, 2k episodes") {
+  constexpr int kNumEpisodes = 2000;
+
+  auto feed = MakePodcast(0, kNumEpisodes);
+  for (auto& episode : *feed.mutable_episodes()) {
+    episode.set_description_long(
+        fmt::format("<p>{}</p>", std::string(1000, 'x')));
+  }
+
+  podcaster::Podcast podcast = feed;
+  podcaster::Database db(TempDataDir("merge"));
+  db.SavePodcast(feed);
+
+  BENCHMARK_ADVANCED("unchanged feed, linear merge")
+  (Catch::Benchmark::Chronometer meter) {
+    meter.measure([&] { LinearMerge(feed, &podcast); });
+  };
+
+  BENCHMARK_ADVANCED("unchanged feed, SavePodcast")
+  (Catch::Benchmark::Chronometer meter) {
+    std::vector<podcaster::Podcast> feeds(meter.runs(), feed);
+    meter.measure([&](int i) { return db.SavePodcast(std::move(feeds[i])); });
+  };
+}
+
+TEST_CASE("Save and load db.bin") {
+  for (int num_episodes : kDatabaseSizes) {
+    auto data_dir = TempDataDir(fmt::format("save_state_{}", num_episodes));
+    {
+      podcaster::Database db(data_dir);
+      for (auto& podcast : MakePodcasts(num_episodes)) {
+        db.SavePodcast(std::move(podcast));
+      }
+
+      // serialize, write and fsync the snapshot
+      BENCHMARK(fmt::format("save, {} episodes", num_episodes)) {
+        db.SaveState();
+        db.Flush();
+      };
+    }
+
+    BENCHMARK_ADVANCED(fmt::format("load, {} episodes", num_episodes))
+    (Catch::Benchmark::Chronometer meter) {
+      // every instance gets its own copy, they write on shutdown
+      std::vector<std::filesystem::path> data_dirs;
+      for (int i = 0; i < meter.runs(); i++) {
+        auto& copy = data_dirs.emplace_back(
+            TempDataDir(fmt::format("load_state_{}", i)));
+        std::filesystem::copy(data_dir, copy,
+                              std::filesystem::copy_options::recursive);
+      }
+      std::vector<std::unique_ptr<podcaster::Database>> dbs(meter.runs());
+      meter.measure([&](int i) {
+        dbs[i] = std::make_unique<podcaster::Database>(data_dirs[i]);
+      });
+    };
+  }
+}
+
+TEST_CASE("Queue update throughput") {
+  for (int num_episodes : kDatabaseSizes) {
+    auto data_dir = TempDataDir(fmt::format("queue_update_{}", num_episodes));
+    std::vector<podcaster::EpisodeUri> uris;
+    {
+      podcaster::Database db(data_dir);
+      for (auto& podcast : MakePodcasts(num_episodes)) {
+        db.SavePodcast(std::move(podcast));
+      }
+      uris = AllEpisodes(db.GetState());
+    }
+
+    podcaster::PodcasterImpl impl(
+        data_dir, podcaster::ServerLimits(podcaster::LoadConfig(data_dir)),
+        [] {});
+
+    // CancelDownload without a live download queues a persisted
+    // NOT_DOWNLOADED update, touching every episode in turn
+    auto cancel = [&uris, next = 0](int num_actions) mutable {
+      podcaster::EpisodeActionBatch batch;
+      for (int i = 0; i < num_actions; i++) {
+        auto* entry = batch.add_entries();
+        *entry->mutable_uri() = uris[next++ % uris.size()];
+        entry->set_action(podcaster::EpisodeAction::ACTION_CANCEL_DOWNLOAD);
+      }
+      return batch;
+    };
+    BENCHMARK(fmt::format("persisted updates, {} episodes", num_episodes)) {
+      impl.ApplyEpisodeActionsImpl(cancel(1));
+    };
+
+    constexpr int kBatchSize = 100;
+    BENCHMARK(fmt::format("{} updates one by one, {} episodes", kBatchSize,
+                          num_episodes)) {
+      for (int i = 0; i < kBatchSize; i++) {
+        impl.ApplyEpisodeActionsImpl(cancel(1));
+      }
+    };
+    BENCHMARK(fmt::format("{} updates in a batch, {} episodes", kBatchSize,
+                          num_episodes)) {
+      impl.ApplyEpisodeActionsImpl(cancel(kBatchSize));
+    };
+  }
+}
+
+TEST_CASE("Transport latency") {
+  auto data_dir = TempDataDir("transport");
+  std::vector<podcaster::EpisodeUri> uris;
+  {
+    podcaster::Database db(data_dir);
+    for (auto& podcast : MakePodcasts(1000)) {
+      db.SavePodcast(std::move(podcast));
+    }
+    uris = AllEpisodes(db.GetState());
+  }
+
+  podcaster::PodcasterImpl impl(
+      data_dir, podcaster::ServerLimits(podcaster::LoadConfig(data_dir)),
+      [] {});
+  int tcp_port = 0;
+  grpc::ServerBuilder builder;
+  builder.AddListeningPort(podcaster::utils::SocketAddress(data_dir),
+                           grpc::InsecureServerCredentials());
+  builder.AddListeningPort("127.0.0.1:0", grpc::InsecureServerCredentials(),
+                           &tcp_port);
+  builder.RegisterService(&impl);
+  std::unique_ptr<grpc::Server> server(builder.BuildAndStart());
+  REQUIRE(server);
+
+  const std::pair<std::string, std::string> transports[] = {
+      {"unix", podcaster::utils::SocketAddress(data_dir)},
+      {"tcp", fmt::format("127.0.0.1:{}", tcp_port)}};
+
+  for (const auto& [name, address] : transports) {
+    auto stub = podcaster::Podcaster::NewStub(
+        grpc::CreateChannel(address, grpc::InsecureChannelCredentials()));
+
+    // the GUI's poll: no changes since the version it has
+    podcaster::StateRequest request;
+    podcaster::DatabaseState state;
+    {
+      grpc::ClientContext context;
+      request.set_delta_only(true);
+      REQUIRE(stub->State(&context, request, &state).ok());
+      request.set_epoch(state.epoch());
+      request.set_since_version(state.version());
+    }
+    BENCHMARK(fmt::format("State poll, {}", name)) {
+      grpc::ClientContext context;
+      return stub->State(&context, request, &state).ok();
+    };
+
+    // CancelDownload without a live download queues one update, measure
+    // until the client reads it from the stream
+    grpc::ClientContext updates_context;
+    auto reader = stub->EpisodeUpdates(&updates_context, podcaster::Empty{});
+    reader->WaitForInitialMetadata();
+    int next = 0;
+    podcaster::EpisodeUpdate update;
+    BENCHMARK(fmt::format("EpisodeUpdates round trip, {}", name)) {
+      grpc::ClientContext context;
+      podcaster::Empty response;
+      stub->CancelDownload(&context, uris[next++ % uris.size()], &response);
+      return reader->Read(&update);
+    };
+    updates_context.TryCancel();
+    reader->Finish();
+  }
+
+  impl.StopUpdateStreams();
+  server->Shutdown();
+}
+
+TEST_CASE("Allocations") {
+  for (int num_episodes : kDatabaseSizes) {
+    podcaster::Database db(TempDataDir(fmt::format("allocs_{}", num_episodes)));
+    auto podcasts = MakePodcasts(num_episodes);
+    for (const auto& podcast : podcasts) {
+      db.SavePodcast(podcast);
+    }
+    // no persistence in the background while counting
+    db.Flush();
+
+    auto update = MakeUpdate(podcasts.front());
+    auto heap_snapshot = CountAllocations([&] {
+      auto snapshot =
+          std::make_shared<const podcaster::DatabaseState>(db.GetState());
+    });
+    auto arena_snapshot = CountAllocations([&] {
+      db.ApplyUpdate(update);
+      auto snapshot = db.Snapshot();
+    });
+    // what the State RPC does with the snapshot
+    auto response = CountAllocations([&] {
+      podcaster::DatabaseState response;
+      response.CopyFrom(*db.Snapshot());
+    });
+
+    // refresh of unchanged feeds, parsed into fresh messages
+    auto heap_refresh = CountAllocations([&] {
+      for (const auto& podcast : podcasts) {
+        podcaster::Podcast parsed = podcast;
+        db.SavePodcast(&parsed);
+      }
+    });
+    auto arena_refresh = CountAllocations([&] {
+      for (const auto& podcast : podcasts) {
+        google::protobuf::Arena arena;
+        auto* parsed =
+            google::protobuf::Arena::CreateMessage<podcaster::Podcast>(&arena);
+        *parsed = podcast;
+        db.SavePodcast(parsed);
+      }
+    });
+
+    fmt::print("{} episodes, allocations:\n", num_episodes);
+    fmt::print("  snapshot: {} heap, {} arena\n", heap_snapshot,
+               arena_snapshot);
+    fmt::print("  State response: {}\n", response);
+    fmt::print("  unchanged refresh: {} heap, {} arena\n", heap_refresh,
+               arena_refresh);
+  }
+}
+
+// Times the render thread's side of ClientWorker, Post and RunCallbacks,
+// while a slow call occupies the worker. The GUI's own frame work is not
+// included.
+TEST_CASE("ClientWorker round trips while a call is in flight") {
+  using Clock = podcaster::FrameStats::Clock;
+  using Millis = podcaster::FrameStats::Millis;
+  constexpr auto kSlowCall = std::chrono::milliseconds(500);
+  constexpr auto kVsync = std::chrono::milliseconds(16);
+
+  podcaster::ClientWorker worker("Bench");
+  bool replied = false;
+  // a call the daemon is slow to answer, like CleanupAll waiting on downloads
+  worker.Post([&] {
+    std::this_thread::sleep_for(kSlowCall);
+    worker.Reply([&] { replied = true; });
+  });
+
+  Clock::duration longest = {};
+  int num_round_trips = 0;
+  while (not replied) {
+    auto start = Clock::now();
+    // posting an action and running the replies, once per frame
+    worker.Post([] {});
+    worker.RunCallbacks();
+    longest = std::max(longest, Clock::now() - start);
+    num_round_trips++;
+    std::this_thread::sleep_for(kVsync);
+  }
+
+  fmt::print(
+      "{} Post and RunCallbacks rounds during a {} ms call, longest {:.3f} "
+      "ms\n",
+      num_round_trips, kSlowCall.count(), Millis(longest).count());
+  REQUIRE(longest < podcaster::FrameStats::kStallThreshold);
+}
@@ -13,6 +13,8 @@
 
 namespace podcaster {
 
+constexpr auto kReconnectInterval = std::chrono::seconds(1);
+
 float ToMB(int bytes) { return static_cast<float>(bytes) / (1024 * 1024); }
 
 std::string ProgressString(int current, int total) {
@@ -95,11 +97,12 @@ Action DrawEpisode(const Podcast& podcast, const Episode& episode,
         }
         ImGui::SameLine();
       }
-      if (episode.description_long().size() > 0) {
+      if (episode.has_description_long_ref()) {
         if (ImGui::Button("Show more")) {
           action |= {ActionType::kShowMore,
-                     ShowMoreExtra{episode.title(), episode.description_short(),
-                                   episode.description_long()}};
+                     ShowMoreExtra{podcast.podcast_uri(), episode.episode_uri(),
+                                   episode.title(),
+                                   episode.description_short(), {}}};
         }
         ImGui::SameLine();
       }
@@ -135,10 +138,16 @@ Action DrawEpisode(const Podcast& podcast, const Episode& episode,
   return action;
 }
 
-void DrawRefreshAnimation() {
+void DrawRefreshAnimation(int feeds_done, int feeds_total) {
   static int frame_counter = 0;
   static const char* dots[] = {"", ".", "..", "..."};
-  ImGui::Text("Refresh in progress%s", dots[(frame_counter++ / 16) % 4]);
+  const char* animation = dots[(frame_counter++ / 16) % 4];
+  if (feeds_total > 0) {
+    ImGui::Text("Refresh in progress (%d / %d feeds)%s", feeds_done,
+                feeds_total, animation);
+  } else {
+    ImGui::Text("Refresh in progress%s", animation);
+  }
 }
 
 Action PodcasterGui::Draw(const Action& incoming_action) {
@@ -157,7 +166,7 @@ Action PodcasterGui::Draw(const Action& incoming_action) {
   ImGui::SeparatorText(label.c_str());
 
   bool top_row_in_focus = false;
-  bool active_refresh = refresh_future_.valid();
+  bool active_refresh = refresh_worker_.Busy();
 
   imgui::EnableIf(not active_refresh, [&] {
     if (ImGui::Button("Refresh")) {
@@ -179,7 +188,7 @@ Action PodcasterGui::Draw(const Action& incoming_action) {
   }
   if (active_refresh) {
     ImGui::SameLine();
-    DrawRefreshAnimation();
+    DrawRefreshAnimation(refresh_feeds_done_, refresh_feeds_total_);
   }
 
   // scroll to top if first item is focused
@@ -225,14 +234,10 @@ Action PodcasterGui::Draw(const Action& incoming_action) {
                 : 0;
     if (ImGui::BeginTabItem("Downloaded", nullptr, flags)) {
       selected_tab_ = 1;
-      for (const auto& podcast : state_.podcasts()) {
-        for (auto iter = podcast.episodes().rbegin();
-             iter != podcast.episodes().rend(); ++iter) {
-          const auto& episode = *iter;
-          if (episode.download_status() == DownloadStatus::DOWNLOAD_SUCCESS) {
-            action |= DrawEpisode(podcast, episode);
-          }
-        }
+      for (const auto& slot :
+           status_index_.WithStatus(DownloadStatus::DOWNLOAD_SUCCESS)) {
+        const auto& podcast = state_.podcasts(slot.podcast);
+        action |= DrawEpisode(podcast, podcast.episodes(slot.episode));
       }
       ImGui::EndTabItem();
     }
@@ -255,10 +260,78 @@ Action PodcasterGui::Draw(const Action& incoming_action) {
   return action;
 }
 
+PodcasterGui::~PodcasterGui() {
+  {
+    std::lock_guard<std::mutex> lock(updates_mutex_);
+    stop_updates_ = true;
+    if (updates_context_) {
+      updates_context_->TryCancel();
+    }
+  }
+  // updates_worker_ finishes the stream as it goes away
+  updates_cv_.notify_one();
+}
+
+void PodcasterGui::SetState(DatabaseState state) {
+  state_ = std::move(state);
+  index_.Rebuild(state_);
+  status_index_.Rebuild(state_);
+}
+
+void PodcasterGui::ApplyState(DatabaseState state) {
+  if (not state.delta()) {
+    SetState(std::move(state));
+  } else if (state.epoch() == state_.epoch()) {
+    utils::MergeChanges(state, &index_, &status_index_, &state_);
+    utils::ApplyNewerUpdates(updates_during_sync_, index_, &status_index_,
+                             &state_);
+  } else {
+    // changes against a state we no longer have
+    Sync();
+  }
+}
+
+void PodcasterGui::Sync() {
+  if (sync_in_flight_) {
+    sync_again_ = true;
+    return;
+  }
+  sync_in_flight_ = client_worker_.Post(
+      [this, epoch = state_.epoch(), version = state_.version()] {
+        auto state = client_.GetState(epoch, version);
+        if (state and not state->delta()) {
+          // different daemon, full resync
+          state = client_.QueryState();
+        }
+        client_worker_.Reply([this, state = std::move(state)]() mutable {
+          sync_in_flight_ = false;
+          // keeps showing the current state while the daemon is unreachable
+          if (state) {
+            ApplyState(std::move(*state));
+          }
+          updates_during_sync_.clear();
+          if (sync_again_) {
+            sync_again_ = false;
+            Sync();
+          }
+        });
+      });
+}
+
+void PodcasterGui::OnFeedResult(const FeedResult& result) {
+  if (not result.error().empty()) {
+    spdlog::warn("Refreshing {} failed: {}", result.feed_uri(),
+                 result.error());
+  }
+  refresh_feeds_done_ = result.feeds_done();
+  refresh_feeds_total_ = result.feeds_total();
+  feeds_changed_ = true;
+}
+
 void PodcasterGui::UpdateServiceStatus(ServiceStatus status) {
   if (service_status_ != status) {
     if (status == ServiceStatus::kOnline) {
-      state_ = client_.GetState();
+      Sync();
     }
     service_status_ = status;
   }
@@ -274,8 +347,14 @@ void PodcasterGui::Run(const Action& incoming_action) {
 
   switch (action.type) {
     case ActionType::kRefresh:
-      refresh_future_ =
-          std::async(std::launch::async, [&] { return client_.Refresh(); });
+      refresh_feeds_done_ = 0;
+      refresh_feeds_total_ = 0;
+      refresh_worker_.Post([this] {
+        client_.Refresh([this](FeedResult result) {
+          refresh_worker_.Reply(
+              [this, result = std::move(result)] { OnFeedResult(result); });
+        });
+      });
       break;
     case ActionType::kDownloadEpisode:
       [[fallthrough]];
@@ -289,58 +368,100 @@ void PodcasterGui::Run(const Action& incoming_action) {
       [[fallthrough]];
     case ActionType::kDeleteEpisode:
       [[fallthrough]];
-    case ActionType::kPlayEpisode: {
-      const auto& extra = std::get<EpisodeExtra>(action.extra);
-      client_.EpisodeAction(extra.podcast_uri, extra.episode_uri, action.type);
+    case ActionType::kPlayEpisode:
+      client_worker_.Post([this, extra = std::get<EpisodeExtra>(action.extra),
+                           type = action.type] {
+        client_.EpisodeAction(extra.podcast_uri, extra.episode_uri, type);
+      });
       break;
-    }
-    case ActionType::kShowMore: {
-      const auto& extra = std::get<ShowMoreExtra>(action.extra);
-      show_more_window_.Open(extra);
+    case ActionType::kShowMore:
+      client_worker_.Post([this,
+                           extra = std::get<ShowMoreExtra>(action.extra)] {
+        auto details =
+            client_.GetEpisodeDetails(extra.podcast_uri, extra.episode_uri);
+        client_worker_.Reply([this, extra, details]() mutable {
+          if (details) {
+            extra.episode_description_long = details->description_long();
+          }
+          show_more_window_.Open(extra);
+        });
+      });
       break;
-    }
     case ActionType::kShowAbout:
       about_window_.Open({.db_path = state_.db_path()});
       break;
     case ActionType::kShowLicenses:
       license_window_.Open();
       break;
-    case ActionType::kShowConfig: {
-      auto config_info = client_.GetConfigInfo();
-      config_window_.Open(config_info);
+    case ActionType::kShowConfig:
+      client_worker_.Post([this] {
+        auto config_info = client_.GetConfigInfo();
+        client_worker_.Reply(
+            [this, config_info] { config_window_.Open(config_info); });
+      });
       break;
-    }
     case ActionType::kShowCleanup:
       cleanup_window_.Open();
       break;
-    case ActionType::kCleanup: {
-      const auto& extra = std::get<CleanupExtra>(action.extra);
-      client_.Cleanup(extra);
-      if (extra.target == CleanupTarget::kAll) {
-        state_ = client_.GetState();
-      }
+    case ActionType::kCleanup:
+      client_worker_.Post(
+          [this, extra = std::get<CleanupExtra>(action.extra)] {
+            client_.Cleanup(extra);
+            if (extra.target == CleanupTarget::kAll) {
+              client_worker_.Reply([this] { Sync(); });
+            }
+          });
       break;
-    }
     default:
       break;
   }
 
-  static int frame_counter = 0;
-  if (frame_counter++ % 60 == 0) {
-    if (refresh_future_.valid() &&
-        refresh_future_.wait_for(std::chrono::seconds(0)) ==
-            std::future_status::ready) {
-      state_ = refresh_future_.get();
-    }
+  client_worker_.RunCallbacks();
+  refresh_worker_.RunCallbacks();
+  // the stream's updates and status
+  // one delta sync covers all feeds finished since the last frame
+  if (feeds_changed_) {
+    feeds_changed_ = false;
+    Sync();
+  }
 
-    ServiceStatus new_status = ServiceStatus::kOffline;
-    if (auto episode_updates = client_.ReadUpdates(); episode_updates) {
-      for (const auto& update : episode_updates.value()) {
-        utils::ApplyUpdate(update, &state_);
-      }
-      new_status = ServiceStatus::kOnline;
+  updates_worker_.RunCallbacks();
+}
+
+void PodcasterGui::UpdatesWorker() {
+  // only the changes, the gui starts out online
+  ServiceStatus reported = ServiceStatus::kOnline;
+  auto report = [&](ServiceStatus status) {
+    if (status != reported) {
+      reported = status;
+      updates_worker_.Reply([this, status] { UpdateServiceStatus(status); });
     }
-    UpdateServiceStatus(new_status);
+  };
+
+  std::unique_lock<std::mutex> lock(updates_mutex_);
+  while (not stop_updates_) {
+    grpc::ClientContext context;
+    updates_context_ = &context;
+    lock.unlock();
+
+    client_.StreamUpdates(
+        &context, [&] { report(ServiceStatus::kOnline); },
+        [this](EpisodeUpdate update) {
+          updates_worker_.Reply([this, update = std::move(update)] {
+            utils::ApplyUpdate(update, index_, &status_index_, &state_);
+            if (sync_in_flight_) {
+              updates_during_sync_.push_back(update);
+            }
+          });
+        });
+    // not under the lock, Reply waits for the render thread
+    report(ServiceStatus::kOffline);
+
+    lock.lock();
+    updates_context_ = nullptr;
+    // daemon went away, try again later
+    updates_cv_.wait_for(lock, kReconnectInterval,
+                         [this] { return stop_updates_; });
   }
 }
 
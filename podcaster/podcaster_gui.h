@@ -3,14 +3,22 @@
 
 #pragma once
 
+#include <algorithm>
+#include <condition_variable>
 #include <filesystem>
-#include <future>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
 
 #include <grpcpp/create_channel.h>
 #include <spdlog/spdlog.h>
 
 #include "podcaster/action.h"
+#include "podcaster/client_worker.h"
+#include "podcaster/database_utils.h"
 #include "podcaster/message.grpc.pb.h"
 #include "podcaster/message.pb.h"
 #include "podcaster/panels/about_window.h"
@@ -23,6 +31,8 @@ namespace podcaster {
 
 class PodcasterClient {
  public:
+  static constexpr int kQueryPageSize = 500;
+
   PodcasterClient(std::shared_ptr<grpc::Channel> channel)
       : stub_(Podcaster::NewStub(channel)) {}
 
@@ -44,20 +54,100 @@ class PodcasterClient {
     stub_->ShutdownIfNotPlaying(&context, request, &response);
   }
 
-  DatabaseState GetState() {
+  // Only the changes since the given version if the epoch still matches,
+  // otherwise a non-delta state without podcasts, see QueryState. Nullopt if
+  // the daemon can't be reached.
+  std::optional<DatabaseState> GetState(uint64_t epoch,
+                                        uint64_t since_version) {
     grpc::ClientContext context;
-    Empty request;
+    StateRequest request;
+    request.set_epoch(epoch);
+    request.set_since_version(since_version);
+    request.set_delta_only(true);
     DatabaseState response;
-    stub_->State(&context, request, &response);
+    grpc::Status status = stub_->State(&context, request, &response);
+    if (!status.ok()) {
+      spdlog::error("Fetching state failed: {}", status.error_message());
+      return {};
+    }
     return response;
   }
 
-  DatabaseState Refresh() {
+  // Full state fetched page by page, with only the fields the GUI renders.
+  // Nullopt if any page fails.
+  std::optional<DatabaseState> QueryState() {
+    QueryRequest request;
+    request.set_page_size(kQueryPageSize);
+    for (const char* path :
+         {"episode_uri", "title", "description_short", "description_long_ref",
+          "download_status", "download_progress", "playback_status",
+          "playback_progress"}) {
+      request.mutable_episode_mask()->add_paths(path);
+    }
+
+    DatabaseState state;
+    do {
+      grpc::ClientContext context;
+      QueryResponse response;
+      grpc::Status status = stub_->Query(&context, request, &response);
+      if (!status.ok()) {
+        spdlog::error("Fetching state failed: {}", status.error_message());
+        return {};
+      }
+      if (request.page_token().empty()) {
+        state.set_db_path(response.db_path());
+        state.set_epoch(response.epoch());
+        state.set_version(response.version());
+      }
+      for (auto& podcast : *response.mutable_podcasts()) {
+        // a podcast can continue on the next page
+        int last = state.podcasts_size() - 1;
+        if (last < 0 or
+            state.podcasts(last).podcast_uri() != podcast.podcast_uri()) {
+          *state.add_podcasts() = std::move(podcast);
+        } else {
+          for (auto& episode : *podcast.mutable_episodes()) {
+            *state.mutable_podcasts(last)->add_episodes() = std::move(episode);
+          }
+        }
+      }
+      request.set_page_token(response.next_page_token());
+    } while (not request.page_token().empty());
+
+    // pages list the newest episodes first
+    for (auto& podcast : *state.mutable_podcasts()) {
+      std::reverse(podcast.mutable_episodes()->begin(),
+                   podcast.mutable_episodes()->end());
+    }
+    return state;
+  }
+
+  // Starts a refresh and blocks until all feeds are done, on_result runs for
+  // each feed as soon as the daemon finished it.
+  void Refresh(const std::function<void(FeedResult)>& on_result) {
+    RefreshJob job;
+    {
+      grpc::ClientContext context;
+      Empty request;
+      grpc::Status status = stub_->Refresh(&context, request, &job);
+      if (!status.ok()) {
+        spdlog::error("Starting refresh failed: {}", status.error_message());
+        return;
+      }
+    }
+
     grpc::ClientContext context;
-    Empty request;
-    DatabaseState response;
-    stub_->Refresh(&context, request, &response);
-    return response;
+    std::unique_ptr<grpc::ClientReader<FeedResult>> reader(
+        stub_->RefreshProgress(&context, job));
+    FeedResult result;
+    while (reader->Read(&result)) {
+      on_result(std::move(result));
+    }
+
+    grpc::Status status = reader->Finish();
+    if (!status.ok()) {
+      spdlog::error("Refresh progress failed: {}", status.error_message());
+    }
   }
 
   std::optional<ConfigInfo> GetConfigInfo() {
@@ -73,25 +163,47 @@ class PodcasterClient {
     return response;
   }
 
-  std::optional<std::vector<EpisodeUpdate>> ReadUpdates() {
+  std::optional<EpisodeDetails> GetEpisodeDetails(
+      const std::string& podcast_uri, const std::string& episode_uri) {
     grpc::ClientContext context;
+    EpisodeUri request;
+    request.set_podcast_uri(podcast_uri);
+    request.set_episode_uri(episode_uri);
+    EpisodeDetails response;
+    grpc::Status status =
+        stub_->GetEpisodeDetails(&context, request, &response);
+    if (!status.ok()) {
+      spdlog::error("Fetching episode details failed: {}",
+                    status.error_message());
+      return {};
+    }
+    return response;
+  }
+
+  // Blocks reading the update stream until the daemon ends it or the
+  // context is cancelled. on_connected runs once the daemon accepted it.
+  void StreamUpdates(grpc::ClientContext* context,
+                     const std::function<void()>& on_connected,
+                     const std::function<void(EpisodeUpdate)>& on_update) {
     Empty request;
     std::unique_ptr<grpc::ClientReader<EpisodeUpdate>> reader(
-        stub_->EpisodeUpdates(&context, request));
+        stub_->EpisodeUpdates(context, request));
 
-    std::vector<EpisodeUpdate> updates;
+    // returns early without the marker if the call failed
+    reader->WaitForInitialMetadata();
+    if (context->GetServerInitialMetadata().count(utils::kUpdatesStreamKey)) {
+      on_connected();
+    }
 
     EpisodeUpdate update;
     while (reader->Read(&update)) {
-      updates.push_back(update);
+      on_update(std::move(update));
     }
 
     grpc::Status status = reader->Finish();
-    if (!status.ok()) {
-      spdlog::error("Read updates failed: {}", status.error_message());
-      return {};
+    if (!status.ok() and status.error_code() != grpc::StatusCode::CANCELLED) {
+      spdlog::error("Update stream failed: {}", status.error_message());
     }
-    return updates;
   }
 
   void EpisodeAction(const std::string& podcast_uri,
@@ -128,6 +240,24 @@ class PodcasterClient {
     }
   }
 
+  // Several actions in one round trip, the daemon persists them together.
+  void EpisodeActions(
+      const std::vector<std::pair<EpisodeUri, ActionType>>& actions) {
+    EpisodeActionBatch request;
+    for (const auto& [uri, action] : actions) {
+      auto* entry = request.add_entries();
+      *entry->mutable_uri() = uri;
+      entry->set_action(ToEpisodeAction(action));
+    }
+    grpc::ClientContext context;
+    Empty response;
+    grpc::Status status =
+        stub_->ApplyEpisodeActions(&context, request, &response);
+    if (!status.ok()) {
+      spdlog::error("Episode actions failed: {}", status.error_message());
+    }
+  }
+
   void Cleanup(const CleanupExtra& extra) {
     grpc::ClientContext context;
     Empty request;
@@ -143,6 +273,27 @@ class PodcasterClient {
   }
 
  private:
+  static podcaster::EpisodeAction ToEpisodeAction(ActionType action) {
+    switch (action) {
+      case ActionType::kDownloadEpisode:
+        return ACTION_DOWNLOAD;
+      case ActionType::kCancelDownload:
+        return ACTION_CANCEL_DOWNLOAD;
+      case ActionType::kPlayEpisode:
+        return ACTION_PLAY;
+      case ActionType::kPauseEpisode:
+        return ACTION_PAUSE;
+      case ActionType::kResumeEpisode:
+        return ACTION_RESUME;
+      case ActionType::kStopEpisode:
+        return ACTION_STOP;
+      case ActionType::kDeleteEpisode:
+        return ACTION_DELETE;
+      default:
+        return ACTION_NONE;
+    }
+  }
+
   std::unique_ptr<podcaster::Podcaster::Stub> stub_;
 };
 
@@ -154,13 +305,20 @@ class PodcasterGui {
       : client_(std::move(client)),
         license_window_(exe_path),
         about_window_(exe_path) {
-    state_ = client_.GetState();
-    auto config_info = client_.GetConfigInfo();
-    if (not config_info or (config_info->config().feed_size() == 0)) {
-      config_window_.Open(config_info);
-    }
+    Sync();
+    client_worker_.Post([this] {
+      auto config_info = client_.GetConfigInfo();
+      client_worker_.Reply([this, config_info] {
+        if (not config_info or (config_info->config().feed_size() == 0)) {
+          config_window_.Open(config_info);
+        }
+      });
+    });
+    updates_worker_.Post([this] { UpdatesWorker(); });
   }
 
+  ~PodcasterGui();
+
   void Run(const Action& incoming_action);
 
   void UpdateServiceStatus(ServiceStatus status);
@@ -168,9 +326,28 @@ class PodcasterGui {
  private:
   Action Draw(const Action& incoming_action);
 
+  void SetState(DatabaseState state);
+
+  // Merges the changes the daemon sent, or fetches the full state again.
+  void ApplyState(DatabaseState state);
+
+  // Catches up with the daemon in the background, transferring only what
+  // changed. At most one sync is in flight, requests meanwhile are merged
+  // into one more.
+  void Sync();
+
+  void OnFeedResult(const FeedResult& result);
+
+  // Keeps the update stream open, reconnecting while the daemon is down.
+  // Runs as the only job of updates_worker_, which hands the updates and
+  // the stream's status to the render thread.
+  void UpdatesWorker();
+
   // db stuff
   PodcasterClient client_;
   DatabaseState state_;
+  utils::EpisodeIndex index_;
+  utils::StatusIndex status_index_;
 
   // subwindows
   ShowMoreWindow show_more_window_;
@@ -179,13 +356,35 @@ class PodcasterGui {
   ConfigWindow config_window_;
   CleanupWindow cleanup_window_;
 
-  // futures
-  std::future<DatabaseState> refresh_future_;
+  // progress of the running refresh
+  int refresh_feeds_done_ = 0;
+  int refresh_feeds_total_ = 0;
+  bool feeds_changed_ = false;
+
+  bool sync_in_flight_ = false;
+  bool sync_again_ = false;
+  // the stream's updates while a sync is in flight, its delta may predate
+  // them
+  std::vector<EpisodeUpdate> updates_during_sync_;
 
   // extra gui stuff
   int selected_tab_ = 0;
   bool last_top_row_in_focus_ = true;
   ServiceStatus service_status_ = ServiceStatus::kOnline;
+
+  // cancels the update stream and its reconnects on shutdown
+  std::mutex updates_mutex_;
+  std::condition_variable updates_cv_;
+  grpc::ClientContext* updates_context_ = nullptr;
+  bool stop_updates_ = false;
+
+  // client calls, their results are applied on the render thread; declared
+  // last to finish the jobs before the rest of the gui goes away
+  ClientWorker client_worker_{"Client calls"};
+  // refreshes block their worker until all feeds are done
+  ClientWorker refresh_worker_{"Refresh"};
+  // reads the update stream for as long as the gui runs
+  ClientWorker updates_worker_{"Updates"};
 };
 
 }  // namespace podcaster
\ No newline at end of file
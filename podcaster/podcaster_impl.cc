@@ -1,7 +1,15 @@
 #include "podcaster/podcaster_impl.h"
 
+#include <fstream>
+
+#include <google/protobuf/arena.h>
+#include <google/protobuf/descriptor.h>
 #include <google/protobuf/text_format.h>
+#include <google/protobuf/util/field_mask_util.h>
 
+#include "podcaster/feed_fetcher.h"
+#include "podcaster/file_utils.h"
+#include "podcaster/rss_parser.h"
 #include "podcaster/tidy_utils.h"
 #include "podcaster/utils.h"
 #include "podcaster/xml_utils.h"
@@ -10,6 +18,78 @@ namespace podcaster {
 
 constexpr int kMaxEpisodesPerPodcast = 10;
 
+// how often the playback position is published while playing
+constexpr auto kPlaybackTick = std::chrono::seconds(1);
+
+// playback ticks between writes of the metrics file
+constexpr int kMetricsTicks = 60;
+
+// an episode may take long to download, only a stall fails it
+constexpr TransferTimeouts kDownloadTimeouts{.total = std::chrono::seconds()};
+
+#ifdef PODCASTER_HANDHELD_BUILD
+constexpr int kDefaultWorkerThreads = 1;
+constexpr int kDefaultMaxGrpcThreads = 4;
+constexpr int kDefaultMemoryQuotaMb = 16;
+constexpr int kDefaultMaxFeedFetches = 4;
+constexpr int kDefaultParseThreads = 4;
+#else
+constexpr int kDefaultWorkerThreads = 2;
+constexpr int kDefaultMaxGrpcThreads = 16;
+constexpr int kDefaultMemoryQuotaMb = 0;
+constexpr int kDefaultMaxFeedFetches = 8;
+constexpr int kDefaultParseThreads = 8;
+#endif
+
+DaemonMetrics::DaemonMetrics()
+    : feed_fetch_latency("feed",
+                         [] {
+                           return std::make_unique<Histogram>(
+                               Histogram::LatencyBounds());
+                         }),
+      feed_parse_latency("feed",
+                         [] {
+                           return std::make_unique<Histogram>(
+                               Histogram::LatencyBounds());
+                         }),
+      download_throughput("episode") {
+  const auto* service =
+      google::protobuf::DescriptorPool::generated_pool()->FindServiceByName(
+          podcaster::Podcaster::service_full_name());
+  for (int i = 0; service and i < service->method_count(); i++) {
+    rpc_latency.try_emplace(service->method(i)->name(),
+                            Histogram::LatencyBounds());
+  }
+}
+
+Histogram* DaemonMetrics::RpcLatency(std::string_view method) {
+  auto iter = rpc_latency.find(method);
+  return iter == rpc_latency.end() ? nullptr : &iter->second;
+}
+
+podcaster::ServerConfig ServerLimits(const podcaster::Config& config) {
+  podcaster::ServerConfig limits = config.server();
+  if (limits.worker_threads() <= 0) {
+    limits.set_worker_threads(kDefaultWorkerThreads);
+  }
+  if (limits.max_grpc_threads() <= 0) {
+    limits.set_max_grpc_threads(kDefaultMaxGrpcThreads);
+  }
+  if (not limits.has_memory_quota_mb()) {
+    limits.set_memory_quota_mb(kDefaultMemoryQuotaMb);
+  }
+  if (limits.max_feed_fetches() <= 0) {
+    limits.set_max_feed_fetches(kDefaultMaxFeedFetches);
+  }
+  if (limits.parse_threads() <= 0) {
+    limits.set_parse_threads(kDefaultParseThreads);
+  }
+  // more would only contend for the cores
+  int cores = std::max(1u, std::thread::hardware_concurrency());
+  limits.set_parse_threads(std::min(limits.parse_threads(), cores));
+  return limits;
+}
+
 podcaster::Config LoadConfig(const std::filesystem::path& data_dir) {
   auto config_path = data_dir / "config.textproto";
 
@@ -26,6 +106,18 @@ podcaster::Config LoadConfig(const std::filesystem::path& data_dir) {
           R"(# Specify the feeds you want to subscribe to, one feed per line:
 # feed: "http://www.2600.com/oth-broadband.xml"
 # feed: "https://podcast.darknetdiaries.com/"
+#
+# Optionally limit the resources of the service, e.g.:
+# server { worker_threads: 1 max_grpc_threads: 4 memory_quota_mb: 16 }
+#
+# Download at most this many feeds at once on refresh:
+# server { max_feed_fetches: 4 }
+#
+# Sanitize episode descriptions on this many threads on refresh:
+# server { parse_threads: 4 }
+#
+# Write metrics.prom in the Prometheus text format every minute:
+# server { write_metrics: true }
 )";
     }
   }
@@ -39,6 +131,52 @@ podcaster::Config LoadConfig(const std::filesystem::path& data_dir) {
   return config;
 }
 
+namespace {
+
+podcaster::EpisodeUpdate DownloadStatusUpdate(
+    const podcaster::EpisodeUri& uri, podcaster::DownloadStatus status) {
+  podcaster::EpisodeUpdate update;
+  update.mutable_uri()->CopyFrom(uri);
+  update.set_new_download_status(status);
+  return update;
+}
+
+podcaster::EpisodeUpdate DownloadProgressUpdate(
+    const podcaster::EpisodeUri& uri, float progress, float size) {
+  podcaster::EpisodeUpdate update;
+  update.mutable_uri()->CopyFrom(uri);
+  auto* download_progress = update.mutable_new_download_progress();
+  download_progress->set_downloaded_bytes(progress);
+  download_progress->set_total_bytes(size);
+  return update;
+}
+
+podcaster::EpisodeUpdate PlaybackStatusUpdate(
+    const podcaster::EpisodeUri& uri, podcaster::PlaybackStatus status) {
+  podcaster::EpisodeUpdate update;
+  update.mutable_uri()->CopyFrom(uri);
+  update.set_new_playback_status(status);
+  return update;
+}
+
+podcaster::EpisodeUpdate PlaybackProgressUpdate(
+    const podcaster::EpisodeUri& uri, int position_ms) {
+  podcaster::EpisodeUpdate update;
+  update.mutable_uri()->CopyFrom(uri);
+  update.set_new_playback_progress(position_ms);
+  return update;
+}
+
+podcaster::EpisodeUpdate PlaybackDurationUpdate(
+    const podcaster::EpisodeUri& uri, int duration_ms) {
+  podcaster::EpisodeUpdate update;
+  update.mutable_uri()->CopyFrom(uri);
+  update.set_new_playback_duration(duration_ms);
+  return update;
+}
+
+}  // namespace
+
 std::string DownloadFilename(const std::string& podcast_uri,
                              const std::string& episode_uri) {
   std::string filename = episode_uri;
@@ -59,6 +197,18 @@ std::string DownloadFilename(const std::string& podcast_uri,
   return fmt::format("{}_{}", hash, filename);
 }
 
+void ClearDataDir(const std::filesystem::path& data_dir) {
+  for (const auto& entry : std::filesystem::directory_iterator(data_dir)) {
+    auto filename = entry.path().filename();
+    // removing the socket would lock out new clients until a restart
+    if (filename == "config.textproto" or filename == "metrics.prom" or
+        entry.is_socket()) {
+      continue;
+    }
+    std::filesystem::remove_all(entry.path());
+  }
+}
+
 int XferInfoCallbackFunctor::Execute(curl_off_t dltotal, curl_off_t dlnow,
                                      curl_off_t ultotal, curl_off_t ulnow) {
   if (cancel_->load()) {
@@ -85,7 +235,7 @@ ParsedDescription ParseDescription(const std::string& input) {
 
   if (!xml_result) {
     spdlog::error("Failed to parse XHTML: {}", xml_result.description());
-    return {input};
+    return {input, {}};
   }
 
   xml::XHTMLStripWalker walker;
@@ -93,65 +243,78 @@ ParsedDescription ParseDescription(const std::string& input) {
   return {walker.ResultShort(), walker.ResultLong()};
 }
 
-std::optional<podcaster::Podcast> DonwloadAndParseFeed(
-    const std::string& feed_uri, const std::filesystem::path& cache_dir) {
-  std::stringstream feed;
-
-  try {
-    curlpp::Easy my_request;
-    my_request.setOpt<curlpp::options::Url>(feed_uri);
-    my_request.setOpt<curlpp::options::WriteStream>(&feed);
-    my_request.setOpt<curlpp::options::FollowLocation>(true);
-#ifdef PODCASTER_HANDHELD_BUILD
-    my_request.setOpt<curlpp::options::CaInfo>(
-        "/etc/ssl/certs/ca-certificates.crt");
-#endif
-    my_request.perform();
-  } catch (const std::exception& e) {
-    spdlog::error("Failed to download feed: {}", e.what());
-    return {};
+// The calling thread is one of the parse threads.
+std::unique_ptr<ThreadPool> DescriptionWorkers(int parse_threads) {
+  if (parse_threads <= 1) {
+    return nullptr;
   }
+  return std::make_unique<ThreadPool>(parse_threads - 1);
+}
 
-  pugi::xml_document doc;
-  pugi::xml_parse_result result = doc.load(feed);
-
-  if (!result) {
-    spdlog::error("Failed to parse feed: {}", result.description());
-    return {};
+// The parsed podcast is allocated on the arena, nullptr on failure with the
+// reason in error. Descriptions are parsed on the calling thread without
+// description_workers.
+podcaster::Podcast* ParseFeed(const std::string& feed_uri,
+                              RssStreamParser* parser,
+                              google::protobuf::Arena* arena,
+                              std::string* error,
+                              DescriptionCache* descriptions,
+                              ThreadPool* description_workers,
+                              DaemonMetrics* metrics) {
+  auto parse_start = Histogram::Clock::now();
+
+  if (not parser->Finish(error)) {
+    spdlog::error(*error);
+    return nullptr;
+  }
+  auto& feed = parser->Result();
+
+  auto* podcast =
+      google::protobuf::Arena::CreateMessage<podcaster::Podcast>(arena);
+  podcast->set_podcast_uri(feed_uri);
+  podcast->set_title(std::move(feed.title));
+
+  // tidy dominates the parse, most descriptions are unchanged and the rest
+  // are sanitized in parallel
+  std::vector<std::optional<ParsedDescription>> parsed(feed.items.size());
+  std::vector<size_t> misses;
+  for (size_t i = 0; i < feed.items.size(); i++) {
+    parsed[i] = descriptions->Lookup(feed_uri, feed.items[i].description);
+    if (parsed[i]) {
+      metrics->description_cache_hits.Add();
+    } else {
+      misses.push_back(i);
+    }
+  }
+  auto parse_miss = [&](size_t miss) {
+    size_t i = misses[miss];
+    parsed[i] = ParseDescription(feed.items[i].description);
+  };
+  if (description_workers) {
+    description_workers->ParallelFor(misses.size(), parse_miss);
+  } else {
+    for (size_t miss = 0; miss < misses.size(); miss++) {
+      parse_miss(miss);
+    }
+  }
+  for (size_t i : misses) {
+    descriptions->Store(feed_uri, feed.items[i].description, *parsed[i]);
+    metrics->description_cache_misses.Add();
   }
 
-  auto title = doc.select_node("/rss/channel/title").node();
-  auto description = doc.select_node("/rss/channel/description").node();
-  auto episodes = doc.select_nodes("/rss/channel/item");
-
-  // sort in reverse document order
-  episodes.sort(true);
-
-  podcaster::Podcast podcast;
-  podcast.set_podcast_uri(feed_uri);
-  podcast.set_title(title.text().as_string());
-
-  const auto* first =
-      std::max(episodes.begin(), episodes.end() - kMaxEpisodesPerPodcast);
-  for (const auto* iter = first; iter != episodes.end(); iter++) {
-    const auto& episode = *iter;
-    const auto& episode_node = episode.node();
-
-    auto title = episode_node.select_node("title").node();
-    auto description = episode_node.select_node("description").node();
-    auto audio_uri =
-        episode_node.select_node("enclosure").node().attribute("url");
-
-    auto parsed_description = ParseDescription(description.text().as_string());
-
-    auto* episode_message = podcast.add_episodes();
-    episode_message->set_title(title.text().as_string());
+  // the newest items come first, episodes are stored oldest first
+  for (size_t i = feed.items.size(); i-- > 0;) {
+    auto& item = feed.items[i];
+    auto* episode_message = podcast->add_episodes();
+    episode_message->set_title(std::move(item.title));
     episode_message->set_description_short(
-        parsed_description.short_description);
-    episode_message->set_description_long(parsed_description.long_description);
-    episode_message->set_episode_uri(audio_uri.as_string());
+        std::move(parsed[i]->short_description));
+    episode_message->set_description_long(
+        std::move(parsed[i]->long_description));
+    episode_message->set_episode_uri(std::move(item.enclosure_url));
   }
 
+  metrics->feed_parse_latency.With(feed_uri)->ObserveSince(parse_start);
   return podcast;
 }
 
@@ -173,7 +336,7 @@ void PlaybackController::Play(const podcaster::EpisodeUri& uri) {
     music_.reset();
   }
 
-  if (auto episode = impl_->db_->FindEpisode(uri); episode) {
+  if (auto episode = impl_->FindEpisode(uri); episode) {
     std::filesystem::path download_path =
         impl_->data_dir_ /
         DownloadFilename(uri.podcast_uri(), uri.episode_uri());
@@ -256,13 +419,31 @@ bool PlaybackController::IsPlaying() const {
 }
 
 PodcasterImpl::PodcasterImpl(std::filesystem::path data_dir,
+                             const podcaster::ServerConfig& limits,
                              std::function<void()> shutdown_callback)
     : data_dir_(data_dir),
       shutdown_callback_(shutdown_callback),
+      write_metrics_(limits.write_metrics()),
       db_(std::make_unique<podcaster::Database>(data_dir)),
-      playback_controller_(this) {}
+      feed_cache_(data_dir_ / "feed_cache.bin"),
+      description_cache_(data_dir_ / "description_cache.bin"),
+      playback_controller_(this),
+      description_workers_(DescriptionWorkers(limits.parse_threads())),
+      workers_(limits.worker_threads()),
+      refresh_worker_(1) {
+  // once everything it may touch is constructed
+  playback_ticker_ = std::thread([this] { PlaybackTicker(); });
+}
 
 PodcasterImpl::~PodcasterImpl() {
+  StopUpdateStreams();
+  {
+    std::lock_guard<std::mutex> lock(ticker_mtx_);
+    stop_ticker_ = true;
+  }
+  ticker_cv_.notify_one();
+  playback_ticker_.join();
+
   std::lock_guard<std::mutex> lock(download_mtx_);
   for (auto& download : downloads_in_progress_) {
     download.cancel->store(true);
@@ -271,202 +452,838 @@ PodcasterImpl::~PodcasterImpl() {
   }
 }
 
-grpc::Status PodcasterImpl::State(grpc::ServerContext* context,
-                                  const podcaster::Empty* request,
-                                  podcaster::DatabaseState* response) {
-  auto state = db_->GetState();
-  response->CopyFrom(state);
-  return grpc::Status::OK;
+grpc::ServerUnaryReactor* PodcasterImpl::FinishInline(
+    grpc::CallbackServerContext* context, std::string_view method,
+    const std::function<grpc::Status()>& handler) {
+  auto start = Histogram::Clock::now();
+  auto* reactor = context->DefaultReactor();
+  reactor->Finish(handler());
+  if (auto* latency = metrics_.RpcLatency(method)) {
+    latency->ObserveSince(start);
+  }
+  return reactor;
+}
+
+grpc::ServerUnaryReactor* PodcasterImpl::FinishOnWorker(
+    grpc::CallbackServerContext* context, std::string_view method,
+    std::function<grpc::Status()> handler) {
+  auto start = Histogram::Clock::now();
+  auto* reactor = context->DefaultReactor();
+  workers_.Submit([reactor, handler = std::move(handler),
+                   latency = metrics_.RpcLatency(method), start] {
+    reactor->Finish(handler());
+    if (latency) {
+      latency->ObserveSince(start);
+    }
+  });
+  return reactor;
+}
+
+grpc::ServerUnaryReactor* PodcasterImpl::State(
+    grpc::CallbackServerContext* context,
+    const podcaster::StateRequest* request,
+    podcaster::DatabaseState* response) {
+  return FinishInline(context, "State", [&] {
+    StateImpl(*request, response);
+    return grpc::Status::OK;
+  });
 }
 
-grpc::Status PodcasterImpl::Refresh(grpc::ServerContext* context,
-                                    const podcaster::Empty* request,
-                                    podcaster::DatabaseState* response) {
+void PodcasterImpl::StateImpl(const podcaster::StateRequest& request,
+                              podcaster::DatabaseState* response) {
+  std::shared_ptr<const podcaster::DatabaseState> state;
+  uint64_t epoch = 0;
+  uint64_t version = 0;
+  {
+    std::lock_guard<std::mutex> lock(db_mutex_);
+    epoch = db_->Epoch();
+    version = db_->Version();
+    if (request.epoch() == epoch and request.since_version() <= version) {
+      *response = db_->Changes(request.since_version());
+      return;
+    }
+    if (request.delta_only()) {
+      response->set_epoch(epoch);
+      response->set_version(version);
+      return;
+    }
+    // different daemon or database instance, full resync
+    state = db_->Snapshot();
+  }
+  response->CopyFrom(*state);
+  response->set_epoch(epoch);
+  response->set_version(version);
+}
+
+grpc::ServerUnaryReactor* PodcasterImpl::Refresh(
+    grpc::CallbackServerContext* context, const podcaster::Empty* request,
+    podcaster::RefreshJob* response) {
+  // reads the config
+  return FinishOnWorker(context, "Refresh", [this, response] {
+    response->set_job_id(StartRefresh());
+    return grpc::Status::OK;
+  });
+}
+
+uint64_t PodcasterImpl::StartRefresh() {
   auto config = LoadConfig(data_dir_);
 
-  std::vector<podcaster::EpisodeUri> all_new_episodes;
+  std::lock_guard<std::mutex> lock(refresh_mtx_);
+  if (refresh_ and not refresh_->Done()) {
+    return refresh_->JobId();
+  }
+  auto refresh = std::make_shared<ActiveRefresh>(++last_refresh_job_,
+                                                 config.feed_size());
+  refresh_ = refresh;
+  std::vector<std::string> feed_uris(config.feed().begin(),
+                                     config.feed().end());
+  refresh_worker_.Submit(
+      [this, refresh, feed_uris = std::move(feed_uris),
+       max_fetches = ServerLimits(config).max_feed_fetches()] {
+        FetchFeeds(refresh, std::move(feed_uris), max_fetches);
+      });
+  return refresh->JobId();
+}
+
+void PodcasterImpl::FetchFeeds(const std::shared_ptr<ActiveRefresh>& refresh,
+                               std::vector<std::string> feed_uris,
+                               int max_fetches) {
+  PruneMetrics(feed_uris);
+  auto merge = std::make_shared<FeedMerge>(feed_uris.size());
 
-  for (const auto& feed : config.feed()) {
-    if (auto podcast = DonwloadAndParseFeed(feed, data_dir_)) {
-      std::lock_guard<std::mutex> lock(db_mutex_);
-      auto new_episodes = db_->SavePodcast(podcast.value());
-      std::move(new_episodes.begin(), new_episodes.end(),
-                std::back_inserter(all_new_episodes));
+  std::vector<FeedRequest> requests;
+  // the bodies are parsed while they download, the transfer ends once the
+  // parser has enough items
+  std::vector<std::shared_ptr<RssStreamParser>> parsers;
+  {
+    // a feed missing from the database is fetched in full even if cached
+    std::lock_guard<std::mutex> lock(db_mutex_);
+    for (const auto& feed_uri : feed_uris) {
+      auto& request = requests.emplace_back(FeedRequest{feed_uri, {}, {}});
+      if (db_->FindPodcast(feed_uri)) {
+        request.validators = feed_cache_.Lookup(feed_uri);
+      }
+      auto& parser = parsers.emplace_back(
+          std::make_shared<RssStreamParser>(kMaxEpisodesPerPodcast));
+      request.sink = [parser = parser.get()](std::string_view data) {
+        return parser->Feed(data);
+      };
     }
   }
 
+  auto shared_uris =
+      std::make_shared<const std::vector<std::string>>(std::move(feed_uris));
+
+  auto parse = [this, refresh, shared_uris, merge](
+                   size_t index, uint64_t cached_hash, FetchedFeed fetched,
+                   const std::shared_ptr<RssStreamParser>& parser) {
+    const auto& feed_uri = (*shared_uris)[index];
+    auto start = std::chrono::steady_clock::now();
+
+    ParsedFeed parsed;
+    if (not fetched.error.empty()) {
+      parsed.error = std::move(fetched.error);
+    } else if (fetched.not_modified or
+               (cached_hash != 0 and
+                fetched.validators.body_hash() == cached_hash)) {
+      parsed.unchanged = true;
+      parsed.validators = std::move(fetched.validators);
+    } else {
+      parsed.arena = std::make_unique<google::protobuf::Arena>();
+      parsed.podcast =
+          ParseFeed(feed_uri, parser.get(), parsed.arena.get(), &parsed.error,
+                    &description_cache_, description_workers_.get(),
+                    &metrics_);
+      parsed.validators = std::move(fetched.validators);
+    }
+    parsed.elapsed =
+        fetched.fetch_time + (std::chrono::steady_clock::now() - start);
+    MergeInOrder(refresh, *shared_uris, merge, index, std::move(parsed));
+  };
+
+  podcaster::FetchFeeds(
+      requests, max_fetches,
+      [&](size_t index, FetchedFeed fetched) {
+        if (fetched.error.empty()) {
+          metrics_.feed_fetch_latency.With((*shared_uris)[index])
+              ->Observe(std::chrono::duration<double>(fetched.fetch_time)
+                           .count());
+        }
+        uint64_t cached_hash = requests[index].validators.body_hash();
+        // the rest of the parse, with the descriptions; the transfers stall
+        // while this thread parses, but a single worker stays free for the
+        // calls
+        auto parser = std::move(parsers[index]);
+        if (workers_.Size() == 1) {
+          parse(index, cached_hash, std::move(fetched), parser);
+        } else {
+          workers_.Submit([parse, index, cached_hash, parser,
+                           fetched = std::move(fetched)]() mutable {
+            parse(index, cached_hash, std::move(fetched), parser);
+          });
+        }
+      },
+      [&] { return refresh->Stopped(); });
+}
+
+void PodcasterImpl::PruneMetrics(const std::vector<std::string>& feed_uris) {
+  std::set<std::string, std::less<>> feeds(feed_uris.begin(), feed_uris.end());
+  std::set<std::string, std::less<>> episodes;
   {
     std::lock_guard<std::mutex> lock(db_mutex_);
-    db_->SaveState();
+    for (const auto& feed_uri : feed_uris) {
+      if (const auto* podcast = db_->FindPodcast(feed_uri)) {
+        for (const auto& episode : podcast->episodes()) {
+          episodes.insert(episode.episode_uri());
+        }
+      }
+    }
+  }
+  auto configured_feed = [&](const std::string& feed_uri) {
+    return feeds.contains(feed_uri);
+  };
+  metrics_.feed_fetch_latency.Retain(configured_feed);
+  metrics_.feed_parse_latency.Retain(configured_feed);
+  metrics_.download_throughput.Retain([&](const std::string& episode_uri) {
+    return episodes.contains(episode_uri);
+  });
+}
+
+void PodcasterImpl::MergeInOrder(const std::shared_ptr<ActiveRefresh>& refresh,
+                                 const std::vector<std::string>& feed_uris,
+                                 const std::shared_ptr<FeedMerge>& merge,
+                                 size_t index, ParsedFeed parsed) {
+  std::unique_lock<std::mutex> lock(merge->mtx);
+  merge->parsed[index] = std::move(parsed);
+  if (merge->merging) {
+    // the thread merging picks it up once its turn comes
+    return;
+  }
+  merge->merging = true;
+  while (merge->next < merge->parsed.size() and
+         merge->parsed[merge->next].has_value()) {
+    size_t next = merge->next;
+    auto ready = std::move(*merge->parsed[next]);
+    merge->parsed[next].reset();
+
+    lock.unlock();
+    MergeFeed(refresh, feed_uris[next], std::move(ready));
+    lock.lock();
+    merge->next++;
+  }
+  merge->merging = false;
+}
+
+void PodcasterImpl::MergeFeed(const std::shared_ptr<ActiveRefresh>& refresh,
+                              const std::string& feed_uri, ParsedFeed parsed) {
+  auto start = std::chrono::steady_clock::now();
+
+  podcaster::FeedResult result;
+  result.set_job_id(refresh->JobId());
+  result.set_feed_uri(feed_uri);
+  if (parsed.unchanged) {
+    result.set_unchanged(true);
+    metrics_.feeds_unchanged.Add();
+    // the server may have sent new validators for the same body
+    feed_cache_.Store(feed_uri, parsed.validators);
+    // its episodes still use the cached descriptions
+    description_cache_.KeepFeed(feed_uri);
+  } else if (parsed.podcast) {
+    {
+      std::lock_guard<std::mutex> lock(db_mutex_);
+      for (auto& uri : db_->SavePodcast(parsed.podcast)) {
+        *result.add_new_episodes() = std::move(uri);
+      }
+    }
+    // only a merged body may make the next fetch conditional
+    feed_cache_.Store(feed_uri, parsed.validators);
+  } else {
+    result.set_error(parsed.error);
+    description_cache_.KeepFeed(feed_uri);
+  }
+  parsed.arena.reset();
+
+  // downloads start without waiting for the remaining feeds
+  if (not refresh->Stopped()) {
+    for (const auto& uri : result.new_episodes()) {
+      DownloadImpl(uri);
+    }
+  }
+
+  result.set_duration_ms(std::chrono::duration_cast<std::chrono::milliseconds>(
+                             parsed.elapsed +
+                             (std::chrono::steady_clock::now() - start))
+                             .count());
+  if (refresh->Publish(std::move(result))) {
+    {
+      std::lock_guard<std::mutex> lock(db_mutex_);
+      db_->SaveState();
+    }
+    feed_cache_.Save();
+    description_cache_.Save();
+  }
+}
+
+grpc::ServerWriteReactor<podcaster::FeedResult>*
+PodcasterImpl::RefreshProgress(grpc::CallbackServerContext* context,
+                               const podcaster::RefreshJob* request) {
+  std::shared_ptr<ActiveRefresh> refresh;
+  std::lock_guard<std::mutex> lock(writers_mtx_);
+  {
+    std::lock_guard<std::mutex> refresh_lock(refresh_mtx_);
+    if (refresh_ and refresh_->JobId() == request->job_id()) {
+      refresh = refresh_;
+    }
+  }
+  auto* writer = new RefreshProgressWriter(refresh);
+  if (refresh) {
+    refresh->Attach(writer);
+    if (streams_stopped_) {
+      refresh->Stop();
+    }
+  }
+  return writer;
+}
+
+bool ActiveRefresh::Publish(podcaster::FeedResult result) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  result.set_feeds_done(results_.size() + 1);
+  result.set_feeds_total(num_feeds_);
+  results_.push_back(std::move(result));
+  for (auto* writer : writers_) {
+    writer->NextWrite();
+  }
+  return DoneLocked();
+}
+
+bool ActiveRefresh::Done() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return DoneLocked();
+}
+
+bool ActiveRefresh::Stopped() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return stopped_;
+}
+
+void ActiveRefresh::Attach(RefreshProgressWriter* writer) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  writers_.push_back(writer);
+  writer->NextWrite();
+}
+
+void ActiveRefresh::Detach(RefreshProgressWriter* writer) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  std::erase(writers_, writer);
+}
+
+void ActiveRefresh::Stop() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  stopped_ = true;
+  for (auto* writer : writers_) {
+    if (not writer->writing_) {
+      writer->FinishOnce(grpc::Status::OK);
+    }
+  }
+}
+
+RefreshProgressWriter::RefreshProgressWriter(
+    std::shared_ptr<ActiveRefresh> refresh)
+    : refresh_(std::move(refresh)) {
+  if (not refresh_) {
+    finished_ = true;
+    Finish(grpc::Status(grpc::StatusCode::NOT_FOUND, "Unknown refresh job"));
+  }
+}
+
+void RefreshProgressWriter::OnWriteDone(bool ok) {
+  std::lock_guard<std::mutex> lock(refresh_->mtx_);
+  writing_ = false;
+  if (not ok or refresh_->stopped_) {
+    // client went away or the daemon is shutting down
+    FinishOnce(grpc::Status::OK);
+    return;
+  }
+  sent_++;
+  NextWrite();
+}
+
+void RefreshProgressWriter::OnCancel() {
+  if (not refresh_) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(refresh_->mtx_);
+  if (not writing_) {
+    FinishOnce(grpc::Status::CANCELLED);
+  }
+}
+
+void RefreshProgressWriter::OnDone() {
+  if (refresh_) {
+    refresh_->Detach(this);
+  }
+  delete this;
+}
+
+void RefreshProgressWriter::NextWrite() {
+  if (writing_ or finished_) {
+    return;
+  }
+  if (sent_ < refresh_->results_.size()) {
+    writing_ = true;
+    StartWrite(&refresh_->results_[sent_]);
+  } else if (refresh_->DoneLocked() or refresh_->stopped_) {
+    FinishOnce(grpc::Status::OK);
+  }
+}
+
+void RefreshProgressWriter::FinishOnce(const grpc::Status& status) {
+  if (not finished_) {
+    finished_ = true;
+    Finish(status);
   }
-  auto state = db_->GetState();
-  response->CopyFrom(state);
+}
 
-  for (const auto& uri : all_new_episodes) {
-    podcaster::Empty response;
-    Download(context, &uri, &response);
+grpc::ServerWriteReactor<podcaster::EpisodeUpdate>*
+PodcasterImpl::EpisodeUpdates(grpc::CallbackServerContext* context,
+                              const podcaster::Empty* request) {
+  // lets the client know the subscription is live
+  context->AddInitialMetadata(utils::kUpdatesStreamKey, "1");
+  UpdateTable::SubscriberId subscriber;
+  {
+    std::lock_guard<std::mutex> lock(updates_mtx_);
+    subscriber = outbound_updates_.Subscribe();
   }
+  auto* writer = new UpdatesWriter(this, subscriber);
 
-  return grpc::Status::OK;
+  std::lock_guard<std::mutex> lock(writers_mtx_);
+  if (streams_stopped_) {
+    writer->Stop();
+  } else {
+    writers_.push_back(writer);
+    writer->Wake();
+  }
+  return writer;
 }
 
-grpc::Status PodcasterImpl::EpisodeUpdates(
-    grpc::ServerContext* context, const podcaster::Empty* request,
-    grpc::ServerWriter<podcaster::EpisodeUpdate>* response) {
-  playback_controller_.UpdatePlayback();
+std::vector<podcaster::EpisodeUpdate> PodcasterImpl::TakeUpdates(
+    UpdateTable::SubscriberId subscriber) {
   std::lock_guard<std::mutex> lock(updates_mtx_);
-  for (const auto& update : outbound_updates_) {
-    response->Write(update);
+  auto updates = outbound_updates_.Read(subscriber);
+  metrics_.outbound_updates.Set(outbound_updates_.Size());
+  return updates;
+}
+
+void PodcasterImpl::RemoveWriter(UpdatesWriter* writer) {
+  {
+    std::lock_guard<std::mutex> lock(writers_mtx_);
+    std::erase(writers_, writer);
   }
-  outbound_updates_.clear();
-  return grpc::Status::OK;
+  std::lock_guard<std::mutex> lock(updates_mtx_);
+  outbound_updates_.Unsubscribe(writer->Subscriber());
+  metrics_.outbound_updates.Set(outbound_updates_.Size());
 }
 
-grpc::Status PodcasterImpl::Play(grpc::ServerContext* context,
-                                 const podcaster::EpisodeUri* request,
-                                 podcaster::Empty* response) {
-  playback_controller_.Play(*request);
-  return grpc::Status::OK;
+void PodcasterImpl::StopUpdateStreams() {
+  std::lock_guard<std::mutex> lock(writers_mtx_);
+  streams_stopped_ = true;
+  for (auto* writer : writers_) {
+    writer->Stop();
+  }
+  std::lock_guard<std::mutex> refresh_lock(refresh_mtx_);
+  if (refresh_) {
+    refresh_->Stop();
+  }
 }
 
-grpc::Status PodcasterImpl::Pause(grpc::ServerContext* context,
-                                  const podcaster::EpisodeUri* request,
-                                  podcaster::Empty* response) {
-  playback_controller_.Pause(*request);
-  return grpc::Status::OK;
+UpdatesWriter::UpdatesWriter(PodcasterImpl* impl,
+                             UpdateTable::SubscriberId subscriber)
+    : impl_(impl), subscriber_(subscriber) {
+  StartSendInitialMetadata();
 }
 
-grpc::Status PodcasterImpl::Resume(grpc::ServerContext* context,
-                                   const podcaster::EpisodeUri* request,
-                                   podcaster::Empty* response) {
-  playback_controller_.Resume(*request);
-  return grpc::Status::OK;
+void UpdatesWriter::Wake() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (not writing_ and not stopping_) {
+    NextWrite();
+  }
 }
 
-grpc::Status PodcasterImpl::Stop(grpc::ServerContext* context,
-                                 const podcaster::EpisodeUri* request,
-                                 podcaster::Empty* response) {
-  playback_controller_.Stop(*request);
-  return grpc::Status::OK;
+void UpdatesWriter::Stop() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  stopping_ = true;
+  if (not writing_) {
+    FinishOnce();
+  }
 }
 
-grpc::Status PodcasterImpl::ShutdownIfNotPlaying(
-    grpc::ServerContext* context, const podcaster::Empty* request,
-    podcaster::Empty* response) {
-  if (not playback_controller_.IsPlaying()) {
-    shutdown_callback_();
+void UpdatesWriter::OnWriteDone(bool ok) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  writing_ = false;
+  pending_.pop_front();
+  if (not ok or stopping_) {
+    // client went away or the daemon is shutting down
+    FinishOnce();
+    return;
   }
-  return grpc::Status::OK;
+  NextWrite();
+}
+
+void UpdatesWriter::OnCancel() { Stop(); }
+
+void UpdatesWriter::OnDone() {
+  impl_->RemoveWriter(this);
+  delete this;
+}
+
+void UpdatesWriter::NextWrite() {
+  if (pending_.empty()) {
+    for (auto& update : impl_->TakeUpdates(subscriber_)) {
+      pending_.push_back(std::move(update));
+    }
+  }
+  if (pending_.empty()) {
+    return;
+  }
+  writing_ = true;
+  StartWrite(&pending_.front());
+}
+
+void UpdatesWriter::FinishOnce() {
+  if (not finished_) {
+    finished_ = true;
+    Finish(grpc::Status::OK);
+  }
+}
+
+void PodcasterImpl::PlaybackTicker() {
+  std::unique_lock<std::mutex> lock(ticker_mtx_);
+  int ticks = 0;
+  while (not ticker_cv_.wait_for(lock, kPlaybackTick,
+                                 [this] { return stop_ticker_; })) {
+    {
+      std::lock_guard<std::mutex> playback_lock(playback_mtx_);
+      playback_controller_.UpdatePlayback();
+    }
+    if (write_metrics_ and ++ticks % kMetricsTicks == 0) {
+      WriteMetrics();
+    }
+  }
+  if (write_metrics_) {
+    WriteMetrics();
+  }
+}
+
+void PodcasterImpl::WriteMetrics() {
+  if (not file::AtomicWrite(data_dir_ / "metrics.prom",
+                            PrometheusText(CollectMetrics()))) {
+    spdlog::error("Failed to write metrics");
+  }
+}
+
+grpc::ServerUnaryReactor* PodcasterImpl::GetMetrics(
+    grpc::CallbackServerContext* context, const podcaster::Empty* request,
+    podcaster::Metrics* response) {
+  return FinishInline(context, "GetMetrics", [&] {
+    *response = CollectMetrics();
+    return grpc::Status::OK;
+  });
+}
+
+podcaster::Metrics PodcasterImpl::CollectMetrics() {
+  podcaster::Metrics metrics;
+  AddMetric("podcaster_feed_fetch_seconds", metrics_.feed_fetch_latency,
+            &metrics);
+  AddMetric("podcaster_feed_parse_seconds", metrics_.feed_parse_latency,
+            &metrics);
+  AddMetric("podcaster_download_bytes_per_second",
+            metrics_.download_throughput, &metrics);
+  AddMetric("podcaster_downloaded_bytes_total", {}, metrics_.downloaded_bytes,
+            &metrics);
+  AddMetric("podcaster_active_downloads", {}, metrics_.active_downloads,
+            &metrics);
+  AddMetric("podcaster_outbound_updates", {}, metrics_.outbound_updates,
+            &metrics);
+  AddMetric("podcaster_feeds_unchanged_total", {}, metrics_.feeds_unchanged,
+            &metrics);
+  AddMetric("podcaster_description_cache_hits_total", {},
+            metrics_.description_cache_hits, &metrics);
+  AddMetric("podcaster_description_cache_misses_total", {},
+            metrics_.description_cache_misses, &metrics);
+  for (const auto& [method, latency] : metrics_.rpc_latency) {
+    AddMetric("podcaster_rpc_seconds", {{"method", method}}, latency,
+              &metrics);
+  }
+
+  // kept by the persistence worker, the lock only keeps CleanupAll from
+  // replacing the database meanwhile
+  std::lock_guard<std::mutex> lock(db_mutex_);
+  auto persistence = db_->GetPersistenceStats();
+  AddMetric("podcaster_save_state_seconds", {}, db_->SaveStateLatency(),
+            &metrics);
+  AddCounter("podcaster_save_state_total", {}, persistence.snapshots,
+             &metrics);
+  AddCounter("podcaster_save_state_bytes_total", {},
+             persistence.snapshot_bytes, &metrics);
+  return metrics;
+}
+
+grpc::ServerUnaryReactor* PodcasterImpl::Play(
+    grpc::CallbackServerContext* context, const podcaster::EpisodeUri* request,
+    podcaster::Empty* response) {
+  // loads the episode file
+  return FinishOnWorker(context, "Play", [this, request] {
+    std::lock_guard<std::mutex> lock(playback_mtx_);
+    playback_controller_.Play(*request);
+    return grpc::Status::OK;
+  });
+}
+
+grpc::ServerUnaryReactor* PodcasterImpl::Pause(
+    grpc::CallbackServerContext* context, const podcaster::EpisodeUri* request,
+    podcaster::Empty* response) {
+  return FinishInline(context, "Pause", [&] {
+    std::lock_guard<std::mutex> lock(playback_mtx_);
+    playback_controller_.Pause(*request);
+    return grpc::Status::OK;
+  });
+}
+
+grpc::ServerUnaryReactor* PodcasterImpl::Resume(
+    grpc::CallbackServerContext* context, const podcaster::EpisodeUri* request,
+    podcaster::Empty* response) {
+  // may load the episode file, like Play
+  return FinishOnWorker(context, "Resume", [this, request] {
+    std::lock_guard<std::mutex> lock(playback_mtx_);
+    playback_controller_.Resume(*request);
+    return grpc::Status::OK;
+  });
+}
+
+grpc::ServerUnaryReactor* PodcasterImpl::Stop(
+    grpc::CallbackServerContext* context, const podcaster::EpisodeUri* request,
+    podcaster::Empty* response) {
+  return FinishInline(context, "Stop", [&] {
+    std::lock_guard<std::mutex> lock(playback_mtx_);
+    playback_controller_.Stop(*request);
+    return grpc::Status::OK;
+  });
+}
+
+grpc::ServerUnaryReactor* PodcasterImpl::ShutdownIfNotPlaying(
+    grpc::CallbackServerContext* context, const podcaster::Empty* request,
+    podcaster::Empty* response) {
+  return FinishInline(context, "ShutdownIfNotPlaying", [&] {
+    bool is_playing = false;
+    {
+      std::lock_guard<std::mutex> lock(playback_mtx_);
+      is_playing = playback_controller_.IsPlaying();
+    }
+    if (not is_playing) {
+      shutdown_callback_();
+    }
+    return grpc::Status::OK;
+  });
 }
 
 void PodcasterImpl::DeleteImpl(const podcaster::EpisodeUri& uri,
-                               QueueFlags flags) {
+                               UpdateBatch* batch) {
   std::filesystem::path download_path =
       data_dir_ / DownloadFilename(uri.podcast_uri(), uri.episode_uri());
   std::filesystem::remove(download_path);
 
-  QueueDownloadProgress(uri, 0, 0, flags);
-  QueueDownloadStatus(uri, podcaster::DownloadStatus::NOT_DOWNLOADED, flags);
-  QueuePlaybackProgress(uri, 0, flags);
-  QueuePlaybackDuration(uri, 0, flags);
+  batch->push_back(DownloadProgressUpdate(uri, 0, 0));
+  batch->push_back(
+      DownloadStatusUpdate(uri, podcaster::DownloadStatus::NOT_DOWNLOADED));
+  batch->push_back(PlaybackProgressUpdate(uri, 0));
+  batch->push_back(PlaybackDurationUpdate(uri, 0));
+}
+
+grpc::ServerUnaryReactor* PodcasterImpl::CleanupDownloads(
+    grpc::CallbackServerContext* context, const podcaster::Empty* request,
+    podcaster::Empty* response) {
+  return FinishOnWorker(context, "CleanupDownloads", [this] {
+    spdlog::info("CleanupDownloads");
+    std::vector<podcaster::EpisodeUri> downloaded;
+    std::vector<podcaster::EpisodeUri> playing;
+    {
+      std::lock_guard<std::mutex> lock(db_mutex_);
+      downloaded =
+          db_->FindEpisodes(podcaster::DownloadStatus::DOWNLOAD_SUCCESS);
+      auto failed =
+          db_->FindEpisodes(podcaster::DownloadStatus::DOWNLOAD_ERROR);
+      downloaded.insert(downloaded.end(), failed.begin(), failed.end());
+      playing = db_->FindEpisodes(podcaster::PlaybackStatus::PLAYING);
+    }
 
-  if (flags == QueueFlags::kPersist) {
-    std::lock_guard<std::mutex> lock(db_mutex_);
-    db_->SaveState();
-  }
-}
-
-grpc::Status PodcasterImpl::CleanupDownloads(grpc::ServerContext* context,
-                                             const podcaster::Empty* request,
-                                             podcaster::Empty* response) {
-  spdlog::info("CleanupDownloads");
-  auto state = db_->GetState();
-  podcaster::EpisodeUri uri;
-  for (const auto& podcast : state.podcasts()) {
-    uri.set_podcast_uri(podcast.podcast_uri());
-    for (const auto& episode : podcast.episodes()) {
-      uri.set_episode_uri(episode.episode_uri());
-
-      if ((episode.download_status() ==
-               podcaster::DownloadStatus::DOWNLOAD_SUCCESS or
-           episode.download_status() ==
-               podcaster::DownloadStatus::DOWNLOAD_ERROR) and
-          episode.playback_status() != podcaster::PlaybackStatus::PLAYING) {
-        // write to disk later in bulk with SaveState
-        DeleteImpl(uri, QueueFlags::kTransient);
+    UpdateBatch batch;
+    for (const auto& uri : downloaded) {
+      bool is_playing =
+          std::any_of(playing.begin(), playing.end(), [&uri](const auto& p) {
+            return p.podcast_uri() == uri.podcast_uri() and
+                   p.episode_uri() == uri.episode_uri();
+          });
+      if (not is_playing) {
+        DeleteImpl(uri, &batch);
       }
     }
-  }
 
-  {
-    std::lock_guard<std::mutex> lock(db_mutex_);
-    db_->SaveState();
-  }
+    // write to disk in bulk with SaveState
+    QueueUpdates(batch, QueueFlags::kTransient);
+    {
+      std::lock_guard<std::mutex> lock(db_mutex_);
+      db_->SaveState();
+    }
 
-  // iterate mp3 files in data_dir_
-  for (const auto& entry : std::filesystem::directory_iterator(data_dir_)) {
-    if (entry.path().extension() == ".mp3") {
-      spdlog::warn("Found orphaned file: {}, deleting", entry.path().string());
-      std::filesystem::remove(entry.path());
+    // iterate mp3 files in data_dir_
+    for (const auto& entry : std::filesystem::directory_iterator(data_dir_)) {
+      if (entry.path().extension() == ".mp3") {
+        spdlog::warn("Found orphaned file: {}, deleting",
+                     entry.path().string());
+        std::filesystem::remove(entry.path());
+      }
     }
-  }
 
-  return grpc::Status::OK;
+    return grpc::Status::OK;
+  });
 }
 
-grpc::Status PodcasterImpl::CleanupAll(grpc::ServerContext* context,
-                                       const podcaster::Empty* request,
-                                       podcaster::Empty* response) {
-  // stop playback
-  playback_controller_ = PlaybackController{this};
+grpc::ServerUnaryReactor* PodcasterImpl::CleanupAll(
+    grpc::CallbackServerContext* context, const podcaster::Empty* request,
+    podcaster::Empty* response) {
+  return FinishOnWorker(context, "CleanupAll", [this] {
+    // stop playback
+    {
+      std::lock_guard<std::mutex> lock(playback_mtx_);
+      playback_controller_ = PlaybackController{this};
+    }
 
-  // stop downloads
-  {
-    std::lock_guard<std::mutex> lock(download_mtx_);
-    for (auto& download : downloads_in_progress_) {
-      download.cancel->store(true);
-      // swallow exceptions
-      download.future.wait();
+    // stop downloads
+    {
+      std::lock_guard<std::mutex> lock(download_mtx_);
+      for (auto& download : downloads_in_progress_) {
+        download.cancel->store(true);
+        // swallow exceptions
+        download.future.wait();
+      }
     }
-  }
 
-  // recreate database
-  {
-    std::lock_guard<std::mutex> lock(db_mutex_);
-    db_.reset();
+    // recreate database
+    {
+      std::lock_guard<std::mutex> lock(db_mutex_);
+      db_.reset();
+      ClearDataDir(data_dir_);
+      db_ = std::make_unique<podcaster::Database>(data_dir_);
+    }
+    return grpc::Status::OK;
+  });
+}
 
-    for (const auto& entry : std::filesystem::directory_iterator(data_dir_)) {
-      if (entry.path().filename() != "config.textproto") {
-        std::filesystem::remove_all(entry.path());
+grpc::ServerUnaryReactor* PodcasterImpl::Delete(
+    grpc::CallbackServerContext* context, const podcaster::EpisodeUri* request,
+    podcaster::Empty* response) {
+  return FinishOnWorker(context, "Delete", [this, request] {
+    if (auto episode = FindEpisode(*request); episode) {
+      if (episode.value().download_status() ==
+          podcaster::DownloadStatus::DOWNLOAD_SUCCESS) {
+        UpdateBatch batch;
+        DeleteImpl(*request, &batch);
+        QueueUpdates(batch, QueueFlags::kPersist);
       }
     }
+    return grpc::Status::OK;
+  });
+}
 
-    db_ = std::make_unique<podcaster::Database>(data_dir_);
-  }
-  return grpc::Status::OK;
+grpc::ServerUnaryReactor* PodcasterImpl::ApplyEpisodeActions(
+    grpc::CallbackServerContext* context,
+    const podcaster::EpisodeActionBatch* request,
+    podcaster::Empty* response) {
+  return FinishOnWorker(context, "ApplyEpisodeActions", [this, request] {
+    ApplyEpisodeActionsImpl(*request);
+    return grpc::Status::OK;
+  });
 }
 
-grpc::Status PodcasterImpl::Delete(grpc::ServerContext* context,
-                                   const podcaster::EpisodeUri* request,
-                                   podcaster::Empty* response) {
-  if (auto episode = db_->FindEpisode(*request); episode) {
-    if (episode.value().download_status() ==
-        podcaster::DownloadStatus::DOWNLOAD_SUCCESS) {
-      DeleteImpl(*request, QueueFlags::kPersist);
+void PodcasterImpl::ApplyEpisodeActionsImpl(
+    const podcaster::EpisodeActionBatch& batch) {
+  // only completed downloads are deleted, look them up together
+  std::vector<bool> deletable(batch.entries_size());
+  {
+    std::lock_guard<std::mutex> lock(db_mutex_);
+    for (int i = 0; i < batch.entries_size(); i++) {
+      const auto& entry = batch.entries(i);
+      if (entry.action() == podcaster::EpisodeAction::ACTION_DELETE) {
+        const auto* episode = db_->FindEpisodeConst(entry.uri());
+        deletable[i] = episode and
+                       episode->download_status() ==
+                           podcaster::DownloadStatus::DOWNLOAD_SUCCESS;
+      }
+    }
+  }
+
+  UpdateBatch updates;
+  for (int i = 0; i < batch.entries_size(); i++) {
+    const auto& uri = batch.entries(i).uri();
+    switch (batch.entries(i).action()) {
+      case podcaster::EpisodeAction::ACTION_DOWNLOAD:
+        DownloadImpl(uri);
+        break;
+      case podcaster::EpisodeAction::ACTION_CANCEL_DOWNLOAD:
+        CancelDownloadImpl(uri, &updates);
+        break;
+      case podcaster::EpisodeAction::ACTION_DELETE:
+        if (deletable[i]) {
+          DeleteImpl(uri, &updates);
+        }
+        break;
+      case podcaster::EpisodeAction::ACTION_PLAY: {
+        std::lock_guard<std::mutex> lock(playback_mtx_);
+        playback_controller_.Play(uri);
+        break;
+      }
+      case podcaster::EpisodeAction::ACTION_PAUSE: {
+        std::lock_guard<std::mutex> lock(playback_mtx_);
+        playback_controller_.Pause(uri);
+        break;
+      }
+      case podcaster::EpisodeAction::ACTION_RESUME: {
+        std::lock_guard<std::mutex> lock(playback_mtx_);
+        playback_controller_.Resume(uri);
+        break;
+      }
+      case podcaster::EpisodeAction::ACTION_STOP: {
+        std::lock_guard<std::mutex> lock(playback_mtx_);
+        playback_controller_.Stop(uri);
+        break;
+      }
+      default:
+        break;
     }
   }
-  return grpc::Status::OK;
+  QueueUpdates(updates, QueueFlags::kPersist);
+}
+
+grpc::ServerUnaryReactor* PodcasterImpl::Download(
+    grpc::CallbackServerContext* context, const podcaster::EpisodeUri* request,
+    podcaster::Empty* response) {
+  return FinishInline(context, "Download", [&] {
+    DownloadImpl(*request);
+    return grpc::Status::OK;
+  });
 }
 
-grpc::Status PodcasterImpl::Download(grpc::ServerContext* context,
-                                     const podcaster::EpisodeUri* request,
-                                     podcaster::Empty* response) {
+void PodcasterImpl::DownloadImpl(const podcaster::EpisodeUri& uri) {
   auto cancel_flag = std::make_unique<std::atomic_bool>(false);
 
-  auto result_future = std::async(std::launch::async, [this, uri = *request,
+  auto result_future = std::async(std::launch::async, [this, uri,
                                                        cancel_ptr =
                                                            cancel_flag.get()] {
     QueueDownloadStatus(uri, podcaster::DownloadStatus::DOWNLOAD_IN_PROGRESS);
+    metrics_.active_downloads.Add(1);
+    ::utils::DestructorCallback download_done(
+        [this] { metrics_.active_downloads.Add(-1); });
+    auto start = Histogram::Clock::now();
 
     std::filesystem::path download_path =
         data_dir_ / DownloadFilename(uri.podcast_uri(), uri.episode_uri());
@@ -483,6 +1300,7 @@ grpc::Status PodcasterImpl::Download(grpc::ServerContext* context,
       my_request.setOpt<curlpp::options::Url>(uri.episode_uri());
       my_request.setOpt<curlpp::options::WriteStream>(&download_file);
       my_request.setOpt<curlpp::options::FollowLocation>(true);
+      SetTimeouts(kDownloadTimeouts, &my_request);
 
       spdlog::info("Downloading: {}", uri.episode_uri());
 #ifdef PODCASTER_HANDHELD_BUILD
@@ -502,6 +1320,12 @@ grpc::Status PodcasterImpl::Download(grpc::ServerContext* context,
       return;
     }
 
+    int64_t size = download_file.tellp();
+    std::chrono::duration<double> duration = Histogram::Clock::now() - start;
+    metrics_.downloaded_bytes.Add(size);
+    metrics_.download_throughput.With(uri.episode_uri())
+        ->Set(size / std::max(duration.count(), 0.001));
+
     QueueDownloadStatus(uri, podcaster::DownloadStatus::DOWNLOAD_SUCCESS);
   });
 
@@ -516,24 +1340,32 @@ grpc::Status PodcasterImpl::Download(grpc::ServerContext* context,
       return false;
     });
     downloads_in_progress_.push_back(
-        ActiveDownload{.uri = *request,
+        ActiveDownload{.uri = uri,
                        .cancel = std::move(cancel_flag),
                        .future = std::move(result_future)});
   }
+}
 
-  return grpc::Status::OK;
+grpc::ServerUnaryReactor* PodcasterImpl::CancelDownload(
+    grpc::CallbackServerContext* context, const podcaster::EpisodeUri* request,
+    podcaster::Empty* response) {
+  return FinishInline(context, "CancelDownload", [&] {
+    UpdateBatch batch;
+    CancelDownloadImpl(*request, &batch);
+    QueueUpdates(batch, QueueFlags::kPersist);
+    return grpc::Status::OK;
+  });
 }
 
-grpc::Status PodcasterImpl::CancelDownload(grpc::ServerContext* context,
-                                           const podcaster::EpisodeUri* request,
-                                           podcaster::Empty* response) {
+void PodcasterImpl::CancelDownloadImpl(const podcaster::EpisodeUri& uri,
+                                       UpdateBatch* batch) {
   bool live_cancel = false;
 
   {
     std::lock_guard<std::mutex> lock(download_mtx_);
     for (auto& download : downloads_in_progress_) {
-      if (download.uri.podcast_uri() == request->podcast_uri() and
-          download.uri.episode_uri() == request->episode_uri()) {
+      if (download.uri.podcast_uri() == uri.podcast_uri() and
+          download.uri.episode_uri() == uri.episode_uri()) {
         download.cancel->store(true);
         live_cancel = true;
       }
@@ -542,84 +1374,145 @@ grpc::Status PodcasterImpl::CancelDownload(grpc::ServerContext* context,
 
   if (not live_cancel) {
     // cleanup in case of unclean shutdown
-    QueueDownloadStatus(*request, podcaster::DownloadStatus::NOT_DOWNLOADED);
+    batch->push_back(
+        DownloadStatusUpdate(uri, podcaster::DownloadStatus::NOT_DOWNLOADED));
   }
-  return grpc::Status::OK;
 }
 
-grpc::Status PodcasterImpl::GetConfigInfo(grpc::ServerContext* context,
-                                          const podcaster::Empty* request,
-                                          podcaster::ConfigInfo* response) {
-  auto config = LoadConfig(data_dir_);
-  response->set_config_path(data_dir_ / "config.textproto");
-  response->mutable_config()->CopyFrom(config);
-  return grpc::Status::OK;
+grpc::ServerUnaryReactor* PodcasterImpl::GetConfigInfo(
+    grpc::CallbackServerContext* context, const podcaster::Empty* request,
+    podcaster::ConfigInfo* response) {
+  // may write the default config
+  return FinishOnWorker(context, "GetConfigInfo", [this, response] {
+    auto config = LoadConfig(data_dir_);
+    response->set_config_path(data_dir_ / "config.textproto");
+    response->mutable_config()->CopyFrom(config);
+    return grpc::Status::OK;
+  });
+}
+
+grpc::ServerUnaryReactor* PodcasterImpl::GetEpisodeDetails(
+    grpc::CallbackServerContext* context, const podcaster::EpisodeUri* request,
+    podcaster::EpisodeDetails* response) {
+  // reads the description from the blob store
+  return FinishOnWorker(
+      context, "GetEpisodeDetails",
+      [this, request, response]() -> grpc::Status {
+        std::optional<std::string> description;
+        {
+          std::lock_guard<std::mutex> lock(db_mutex_);
+          description = db_->LoadDescription(*request);
+        }
+        if (not description) {
+          return {grpc::StatusCode::NOT_FOUND,
+                  "Episode details not available"};
+        }
+        response->set_description_long(std::move(description.value()));
+        return grpc::Status::OK;
+      });
+}
+
+grpc::ServerUnaryReactor* PodcasterImpl::FilterEpisodes(
+    grpc::CallbackServerContext* context,
+    const podcaster::EpisodeFilter* request,
+    podcaster::DatabaseState* response) {
+  return FinishInline(context, "FilterEpisodes", [&] {
+    std::lock_guard<std::mutex> lock(db_mutex_);
+    *response = db_->FilterEpisodes(*request);
+    return grpc::Status::OK;
+  });
+}
+
+grpc::ServerUnaryReactor* PodcasterImpl::Query(
+    grpc::CallbackServerContext* context,
+    const podcaster::QueryRequest* request,
+    podcaster::QueryResponse* response) {
+  return FinishInline(context, "Query", [&] {
+    if (not google::protobuf::util::FieldMaskUtil::IsValidFieldMask<
+            podcaster::Episode>(request->episode_mask())) {
+      return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                          "Invalid field mask");
+    }
+    std::lock_guard<std::mutex> lock(db_mutex_);
+    auto page = db_->Query(*request);
+    if (not page) {
+      return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                          "Invalid or expired page token");
+    }
+    *response = std::move(*page);
+    return grpc::Status::OK;
+  });
+}
+
+std::optional<podcaster::Episode> PodcasterImpl::FindEpisode(
+    const podcaster::EpisodeUri& uri) {
+  std::lock_guard<std::mutex> lock(db_mutex_);
+  return db_->FindEpisode(uri);
 }
 
 void PodcasterImpl::QueueUpdate(const podcaster::EpisodeUpdate& update,
                                 QueueFlags flags) {
-  {
-    std::lock_guard<std::mutex> lock(updates_mtx_);
-    // cleanup superseded updates
-    std::erase_if(outbound_updates_, [&update](const auto& u) {
-      return u.uri().podcast_uri() == update.uri().podcast_uri() &&
-             u.uri().episode_uri() == update.uri().episode_uri() &&
-             u.status_case() == update.status_case();
-    });
-    outbound_updates_.push_back(update);
+  QueueUpdates(std::span<const podcaster::EpisodeUpdate>(&update, 1), flags);
+}
+
+void PodcasterImpl::QueueUpdates(
+    std::span<const podcaster::EpisodeUpdate> updates, QueueFlags flags) {
+  if (updates.empty()) {
+    return;
   }
   {
-    std::lock_guard<std::mutex> lock(db_mutex_);
-    db_->ApplyUpdate(update);
+    // subscribers only see what State and Changes already reflect, in the
+    // order it was applied
+    std::lock_guard<std::mutex> db_lock(db_mutex_);
+    // stamped, so that clients can tell which syncs already include them
+    std::vector<podcaster::EpisodeUpdate> stamped(updates.begin(),
+                                                  updates.end());
+    for (auto& update : stamped) {
+      update.set_version(db_->ApplyUpdate(update));
+    }
     if (flags == QueueFlags::kPersist) {
-      db_->SaveState();
+      db_->AppendToJournal(updates);
+    }
+
+    std::lock_guard<std::mutex> lock(updates_mtx_);
+    for (const auto& update : stamped) {
+      // replaces a superseded update still waiting for a subscriber
+      outbound_updates_.Put(update);
     }
+    metrics_.outbound_updates.Set(outbound_updates_.Size());
+  }
+  std::lock_guard<std::mutex> lock(writers_mtx_);
+  for (auto* writer : writers_) {
+    writer->Wake();
   }
 }
 
 void PodcasterImpl::QueueDownloadStatus(const podcaster::EpisodeUri& request,
                                         podcaster::DownloadStatus status,
                                         QueueFlags flags) {
-  podcaster::EpisodeUpdate update;
-  update.mutable_uri()->CopyFrom(request);
-  update.set_new_download_status(status);
-  QueueUpdate(update, flags);
+  QueueUpdate(DownloadStatusUpdate(request, status), flags);
 }
 
 void PodcasterImpl::QueueDownloadProgress(const podcaster::EpisodeUri& request,
                                           float progress, float size,
                                           QueueFlags flags) {
-  podcaster::EpisodeUpdate update;
-  update.mutable_uri()->CopyFrom(request);
-  auto* download_progress = update.mutable_new_download_progress();
-  download_progress->set_downloaded_bytes(progress);
-  download_progress->set_total_bytes(size);
-  QueueUpdate(update, flags);
+  QueueUpdate(DownloadProgressUpdate(request, progress, size), flags);
 }
 
 void PodcasterImpl::QueuePlaybackStatus(const podcaster::EpisodeUri& request,
                                         podcaster::PlaybackStatus status,
                                         QueueFlags flags) {
-  podcaster::EpisodeUpdate update;
-  update.mutable_uri()->CopyFrom(request);
-  update.set_new_playback_status(status);
-  QueueUpdate(update, flags);
+  QueueUpdate(PlaybackStatusUpdate(request, status), flags);
 }
 
 void PodcasterImpl::QueuePlaybackProgress(const podcaster::EpisodeUri& request,
                                           int position_ms, QueueFlags flags) {
-  podcaster::EpisodeUpdate update;
-  update.mutable_uri()->CopyFrom(request);
-  update.set_new_playback_progress(position_ms);
-  QueueUpdate(update, flags);
+  QueueUpdate(PlaybackProgressUpdate(request, position_ms), flags);
 }
 
 void PodcasterImpl::QueuePlaybackDuration(const podcaster::EpisodeUri& request,
                                           int duration_ms, QueueFlags flags) {
-  podcaster::EpisodeUpdate update;
-  update.mutable_uri()->CopyFrom(request);
-  update.set_new_playback_duration(duration_ms);
-  QueueUpdate(update, flags);
+  QueueUpdate(PlaybackDurationUpdate(request, duration_ms), flags);
 }
 
 }  // namespace podcaster
\ No newline at end of file
@@ -1,31 +1,49 @@
 #pragma once
 
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <future>
+#include <map>
 #include <memory>
+#include <optional>
+#include <set>
+#include <span>
+#include <string_view>
+#include <thread>
 #include <vector>
 
 #include <curlpp/cURLpp.hpp>
 #include <curlpp/Easy.hpp>
 #include <curlpp/Options.hpp>
+#include <google/protobuf/arena.h>
 
 #include "podcaster/database.h"
+#include "podcaster/description_cache.h"
+#include "podcaster/feed_fetcher.h"
 #include "podcaster/message.grpc.pb.h"
 #include "podcaster/message.pb.h"
+#include "podcaster/metrics.h"
 #include "podcaster/sdl_mixer_utils.h"
+#include "podcaster/thread_pool.h"
+#include "podcaster/update_table.h"
 
 namespace podcaster {
 
-struct ParsedDescription {
-  std::string short_description;
-  std::string long_description;
-};
-
 ParsedDescription ParseDescription(const std::string& input);
 
 std::string DownloadFilename(const std::string& podcast_uri, const std::string& episode_uri);
 
+// Deletes everything in the data directory but the config, the metrics file
+// and the socket the daemon listens on.
+void ClearDataDir(const std::filesystem::path& data_dir);
+
 enum class QueueFlags { kTransient, kPersist };
 
+// Updates collected by one call, queued together with QueueUpdates.
+using UpdateBatch = std::vector<podcaster::EpisodeUpdate>;
+
 struct ActiveDownload {
   podcaster::EpisodeUri uri;
   std::unique_ptr<std::atomic_bool> cancel;
@@ -81,77 +99,353 @@ class PlaybackController {
   PodcasterImpl* impl_;
 };
 
-class PodcasterImpl final : public podcaster::Podcaster::Service {
+// Sends queued episode updates to one EpisodeUpdates subscriber, one
+// write in flight at a time.
+class UpdatesWriter final
+    : public grpc::ServerWriteReactor<podcaster::EpisodeUpdate> {
+ public:
+  UpdatesWriter(PodcasterImpl* impl, UpdateTable::SubscriberId subscriber);
+
+  UpdateTable::SubscriberId Subscriber() const { return subscriber_; }
+
+  // Starts writing newly queued updates unless a write is in flight.
+  void Wake();
+
+  // Ends the stream once the write in flight completes.
+  void Stop();
+
+  void OnWriteDone(bool ok) override;
+
+  void OnCancel() override;
+
+  void OnDone() override;
+
+ private:
+  // Requires mtx_.
+  void NextWrite();
+
+  // Requires mtx_.
+  void FinishOnce();
+
+  PodcasterImpl* impl_;
+  const UpdateTable::SubscriberId subscriber_;
+
+  std::mutex mtx_;
+  std::deque<podcaster::EpisodeUpdate> pending_;
+  bool writing_ = false;
+  bool stopping_ = false;
+  bool finished_ = false;
+};
+
+class RefreshProgressWriter;
+
+// Feed results of one refresh job, kept after the job finished so that a
+// late RefreshProgress subscriber still receives all of them.
+class ActiveRefresh {
+ public:
+  ActiveRefresh(uint64_t job_id, int num_feeds)
+      : job_id_(job_id), num_feeds_(num_feeds) {}
+
+  uint64_t JobId() const { return job_id_; }
+
+  // Adds the result of one feed and wakes the subscribers, true for the
+  // last feed of the job.
+  bool Publish(podcaster::FeedResult result);
+
+  bool Done();
+
+  // Set on shutdown, feeds not started yet are skipped.
+  bool Stopped();
+
+  // Starts writing the results published so far.
+  void Attach(RefreshProgressWriter* writer);
+
+  void Detach(RefreshProgressWriter* writer);
+
+  // Ends all streams once their write in flight completes.
+  void Stop();
+
+ private:
+  // Requires mtx_.
+  bool DoneLocked() const { return results_.size() == num_feeds_; }
+
+  const uint64_t job_id_;
+  const size_t num_feeds_;
+
+  std::mutex mtx_;
+  // a deque keeps the result in flight in place while others are added
+  std::deque<podcaster::FeedResult> results_;
+  std::vector<RefreshProgressWriter*> writers_;
+  bool stopped_ = false;
+
+  friend class RefreshProgressWriter;
+};
+
+// A feed of a refresh job parsed ahead of the feeds before it in the config.
+struct ParsedFeed {
+  // most of a parsed feed is unchanged and thrown away by the merge,
+  // allocate it in bulk and free it at once
+  std::unique_ptr<google::protobuf::Arena> arena;
+  // on the arena, nullptr on failure
+  podcaster::Podcast* podcast = nullptr;
+  std::string error;
+  // the body is the one merged last time, nothing was parsed
+  bool unchanged = false;
+  // stored in the feed cache once the podcast is merged, or right away if
+  // unchanged
+  podcaster::FeedValidators validators;
+  // fetching and parsing, without the wait for its turn
+  std::chrono::steady_clock::duration elapsed{};
+};
+
+// Parsed feeds of one refresh job, merged into the database in config order
+// so that the result doesn't depend on which download finished first.
+struct FeedMerge {
+  explicit FeedMerge(size_t num_feeds) : parsed(num_feeds) {}
+
+  std::mutex mtx;
+  std::vector<std::optional<ParsedFeed>> parsed;
+  // index of the next feed to merge
+  size_t next = 0;
+  // one thread merges at a time
+  bool merging = false;
+};
+
+// Sends the results of one refresh job to a RefreshProgress subscriber, all
+// state is guarded by the job's mutex.
+class RefreshProgressWriter final
+    : public grpc::ServerWriteReactor<podcaster::FeedResult> {
+ public:
+  // Without a job the stream ends right away with NOT_FOUND.
+  explicit RefreshProgressWriter(std::shared_ptr<ActiveRefresh> refresh);
+
+  void OnWriteDone(bool ok) override;
+
+  void OnCancel() override;
+
+  void OnDone() override;
+
+ private:
+  // Requires the job's mutex.
+  void NextWrite();
+
+  // Requires the job's mutex.
+  void FinishOnce(const grpc::Status& status);
+
+  std::shared_ptr<ActiveRefresh> refresh_;
+
+  size_t sent_ = 0;
+  bool writing_ = false;
+  bool finished_ = false;
+
+  friend class ActiveRefresh;
+};
+
+// What the daemon measures, exported by GetMetrics.
+struct DaemonMetrics {
+  // one latency histogram per rpc of the service
+  DaemonMetrics();
+
+  // nullptr for an unknown rpc, lock-free
+  Histogram* RpcLatency(std::string_view method);
+
+  Family<Histogram> feed_fetch_latency;
+  Family<Histogram> feed_parse_latency;
+  // of the last download of each episode, in bytes per second
+  Family<Gauge> download_throughput;
+  Counter downloaded_bytes;
+  Gauge active_downloads;
+  Gauge outbound_updates;
+  // skipped by a refresh, answered with 304 or an identical body
+  Counter feeds_unchanged;
+  Counter description_cache_hits;
+  Counter description_cache_misses;
+
+  // not modified after construction
+  std::map<std::string, Histogram, std::less<>> rpc_latency;
+};
+
+// Config limits with the build's defaults filled in.
+podcaster::ServerConfig ServerLimits(const podcaster::Config& config);
+
+podcaster::Config LoadConfig(const std::filesystem::path& data_dir);
+
+// Handlers run on gRPC's callback threads and must not block them, calls
+// waiting on the network or disk are finished on the worker pool.
+class PodcasterImpl final : public podcaster::Podcaster::CallbackService {
  public:
-  explicit PodcasterImpl(std::filesystem::path data_dir,
-                         std::function<void()> shutdown_callback);
+  // The limits are the config's with the defaults filled in by
+  // ServerLimits.
+  PodcasterImpl(std::filesystem::path data_dir,
+                const podcaster::ServerConfig& limits,
+                std::function<void()> shutdown_callback);
   ~PodcasterImpl();
   PodcasterImpl(const PodcasterImpl&) = delete;
   PodcasterImpl& operator=(const PodcasterImpl&) = delete;
   PodcasterImpl(PodcasterImpl&&) = delete;
   PodcasterImpl& operator=(PodcasterImpl&&) = delete;
 
-  grpc::Status State(grpc::ServerContext* context,
-                     const podcaster::Empty* request,
-                     podcaster::DatabaseState* response) override;
+  grpc::ServerUnaryReactor* State(grpc::CallbackServerContext* context,
+                                  const podcaster::StateRequest* request,
+                                  podcaster::DatabaseState* response) override;
 
-  grpc::Status Refresh(grpc::ServerContext* context,
-                       const podcaster::Empty* request,
-                       podcaster::DatabaseState* response) override;
+  grpc::ServerUnaryReactor* Refresh(grpc::CallbackServerContext* context,
+                                    const podcaster::Empty* request,
+                                    podcaster::RefreshJob* response) override;
 
-  grpc::Status EpisodeUpdates(
-      grpc::ServerContext* context, const podcaster::Empty* request,
-      grpc::ServerWriter<podcaster::EpisodeUpdate>* response) override;
+  grpc::ServerWriteReactor<podcaster::FeedResult>* RefreshProgress(
+      grpc::CallbackServerContext* context,
+      const podcaster::RefreshJob* request) override;
 
-  grpc::Status Play(grpc::ServerContext* context,
-                    const podcaster::EpisodeUri* request,
-                    podcaster::Empty* response) override;
+  grpc::ServerWriteReactor<podcaster::EpisodeUpdate>* EpisodeUpdates(
+      grpc::CallbackServerContext* context,
+      const podcaster::Empty* request) override;
 
-  grpc::Status Pause(grpc::ServerContext* context,
-                     const podcaster::EpisodeUri* request,
-                     podcaster::Empty* response) override;
+  grpc::ServerUnaryReactor* Play(grpc::CallbackServerContext* context,
+                                 const podcaster::EpisodeUri* request,
+                                 podcaster::Empty* response) override;
 
-  grpc::Status Resume(grpc::ServerContext* context,
-                      const podcaster::EpisodeUri* request,
-                      podcaster::Empty* response) override;
+  grpc::ServerUnaryReactor* Pause(grpc::CallbackServerContext* context,
+                                  const podcaster::EpisodeUri* request,
+                                  podcaster::Empty* response) override;
 
-  grpc::Status Stop(grpc::ServerContext* context,
-                    const podcaster::EpisodeUri* request,
-                    podcaster::Empty* response) override;
+  grpc::ServerUnaryReactor* Resume(grpc::CallbackServerContext* context,
+                                   const podcaster::EpisodeUri* request,
+                                   podcaster::Empty* response) override;
 
-  grpc::Status ShutdownIfNotPlaying(grpc::ServerContext* context,
-                                    const podcaster::Empty* request,
-                                    podcaster::Empty* response) override;
+  grpc::ServerUnaryReactor* Stop(grpc::CallbackServerContext* context,
+                                 const podcaster::EpisodeUri* request,
+                                 podcaster::Empty* response) override;
 
-  void DeleteImpl(const podcaster::EpisodeUri& uri, QueueFlags flags);
+  grpc::ServerUnaryReactor* ShutdownIfNotPlaying(
+      grpc::CallbackServerContext* context, const podcaster::Empty* request,
+      podcaster::Empty* response) override;
 
-  grpc::Status CleanupDownloads(grpc::ServerContext* context,
-                                const podcaster::Empty* request,
-                                podcaster::Empty* response) override;
+  grpc::ServerUnaryReactor* ApplyEpisodeActions(
+      grpc::CallbackServerContext* context,
+      const podcaster::EpisodeActionBatch* request,
+      podcaster::Empty* response) override;
 
-  grpc::Status CleanupAll(grpc::ServerContext* context,
-                          const podcaster::Empty* request,
-                          podcaster::Empty* response) override;
+  // Runs the actions in order, their updates are applied under one database
+  // lock and persisted together.
+  void ApplyEpisodeActionsImpl(const podcaster::EpisodeActionBatch& batch);
 
-  grpc::Status Delete(grpc::ServerContext* context,
-                      const podcaster::EpisodeUri* request,
-                      podcaster::Empty* response) override;
+  // Removes the download, the reset episode state goes to the batch.
+  void DeleteImpl(const podcaster::EpisodeUri& uri, UpdateBatch* batch);
 
-  grpc::Status Download(grpc::ServerContext* context,
-                        const podcaster::EpisodeUri* request,
-                        podcaster::Empty* response) override;
+  void CancelDownloadImpl(const podcaster::EpisodeUri& uri,
+                          UpdateBatch* batch);
 
-  grpc::Status CancelDownload(grpc::ServerContext* context,
-                              const podcaster::EpisodeUri* request,
-                              podcaster::Empty* response) override;
+  // Ends all EpisodeUpdates and RefreshProgress streams, call before
+  // shutting down the server, which otherwise waits for them forever.
+  void StopUpdateStreams();
 
-  grpc::Status GetConfigInfo(grpc::ServerContext* context,
-                             const podcaster::Empty* request,
-                             podcaster::ConfigInfo* response) override;
+  grpc::ServerUnaryReactor* CleanupDownloads(
+      grpc::CallbackServerContext* context, const podcaster::Empty* request,
+      podcaster::Empty* response) override;
+
+  grpc::ServerUnaryReactor* CleanupAll(grpc::CallbackServerContext* context,
+                                       const podcaster::Empty* request,
+                                       podcaster::Empty* response) override;
+
+  grpc::ServerUnaryReactor* Delete(grpc::CallbackServerContext* context,
+                                   const podcaster::EpisodeUri* request,
+                                   podcaster::Empty* response) override;
+
+  grpc::ServerUnaryReactor* Download(grpc::CallbackServerContext* context,
+                                     const podcaster::EpisodeUri* request,
+                                     podcaster::Empty* response) override;
+
+  grpc::ServerUnaryReactor* CancelDownload(
+      grpc::CallbackServerContext* context,
+      const podcaster::EpisodeUri* request,
+      podcaster::Empty* response) override;
+
+  grpc::ServerUnaryReactor* GetConfigInfo(
+      grpc::CallbackServerContext* context, const podcaster::Empty* request,
+      podcaster::ConfigInfo* response) override;
+
+  grpc::ServerUnaryReactor* GetEpisodeDetails(
+      grpc::CallbackServerContext* context,
+      const podcaster::EpisodeUri* request,
+      podcaster::EpisodeDetails* response) override;
+
+  grpc::ServerUnaryReactor* FilterEpisodes(
+      grpc::CallbackServerContext* context,
+      const podcaster::EpisodeFilter* request,
+      podcaster::DatabaseState* response) override;
+
+  grpc::ServerUnaryReactor* Query(grpc::CallbackServerContext* context,
+                                  const podcaster::QueryRequest* request,
+                                  podcaster::QueryResponse* response) override;
+
+  grpc::ServerUnaryReactor* GetMetrics(grpc::CallbackServerContext* context,
+                                       const podcaster::Empty* request,
+                                       podcaster::Metrics* response) override;
+
+  podcaster::Metrics CollectMetrics();
 
  private:
+  // Finishes the call right away, for handlers that return quickly. The
+  // time it took is recorded as the latency of the method.
+  grpc::ServerUnaryReactor* FinishInline(
+      grpc::CallbackServerContext* context, std::string_view method,
+      const std::function<grpc::Status()>& handler);
+
+  // Finishes the call once the handler ran on the worker pool, the latency
+  // includes the wait for a free worker.
+  grpc::ServerUnaryReactor* FinishOnWorker(
+      grpc::CallbackServerContext* context, std::string_view method,
+      std::function<grpc::Status()> handler);
+
+  // Publishes the playback position while an episode is playing, and writes
+  // the metrics file if enabled.
+  void PlaybackTicker();
+
+  void WriteMetrics();
+
+  void DownloadImpl(const podcaster::EpisodeUri& uri);
+
+  // Id of the refresh job started, or of the one still running.
+  uint64_t StartRefresh();
+
+  // Downloads the feeds of the job concurrently, parsing each as it
+  // completes.
+  void FetchFeeds(const std::shared_ptr<ActiveRefresh>& refresh,
+                  std::vector<std::string> feed_uris, int max_fetches);
+
+  // Drops the metric series of feeds no longer in the config, and of their
+  // episodes.
+  void PruneMetrics(const std::vector<std::string>& feed_uris);
+
+  // Stores the parsed feed and merges all feeds whose turn has come.
+  void MergeInOrder(const std::shared_ptr<ActiveRefresh>& refresh,
+                    const std::vector<std::string>& feed_uris,
+                    const std::shared_ptr<FeedMerge>& merge, size_t index,
+                    ParsedFeed parsed);
+
+  // Merges one feed into the database and publishes its result.
+  void MergeFeed(const std::shared_ptr<ActiveRefresh>& refresh,
+                 const std::string& feed_uri, ParsedFeed parsed);
+
+  // Queued updates not yet sent to the subscriber.
+  std::vector<podcaster::EpisodeUpdate> TakeUpdates(
+      UpdateTable::SubscriberId subscriber);
+
+  void RemoveWriter(UpdatesWriter* writer);
+
+  // Full state, or only the changes if the request's epoch still matches.
+  void StateImpl(const podcaster::StateRequest& request,
+                 podcaster::DatabaseState* response);
+
+  std::optional<podcaster::Episode> FindEpisode(
+      const podcaster::EpisodeUri& uri);
+
   void QueueUpdate(const podcaster::EpisodeUpdate& update, QueueFlags flags);
 
+  void QueueUpdates(std::span<const podcaster::EpisodeUpdate> updates,
+                    QueueFlags flags);
+
   void QueueDownloadStatus(const podcaster::EpisodeUri& request,
                            podcaster::DownloadStatus status,
                            QueueFlags flags = QueueFlags::kPersist);
@@ -174,20 +468,55 @@ class PodcasterImpl final : public podcaster::Podcaster::Service {
 
   std::filesystem::path data_dir_;
   std::function<void()> shutdown_callback_;
+  bool write_metrics_;
+
+  DaemonMetrics metrics_;
 
   std::mutex download_mtx_;
   std::vector<ActiveDownload> downloads_in_progress_;
 
+  // locked after db_mutex_
   std::mutex updates_mtx_;
-  std::vector<podcaster::EpisodeUpdate> outbound_updates_;
+  UpdateTable outbound_updates_;
+
+  // locked before a writer's own mutex
+  std::mutex writers_mtx_;
+  std::vector<UpdatesWriter*> writers_;
+  bool streams_stopped_ = false;
+
+  // the latest refresh job, locked after writers_mtx_
+  std::mutex refresh_mtx_;
+  std::shared_ptr<ActiveRefresh> refresh_;
+  uint64_t last_refresh_job_ = 0;
 
   std::mutex db_mutex_;
   std::unique_ptr<podcaster::Database> db_;
 
+  FeedCache feed_cache_;
+  DescriptionCache description_cache_;
+
   std::mutex playback_mtx_;
   PlaybackController playback_controller_;
 
+  std::mutex ticker_mtx_;
+  std::condition_variable ticker_cv_;
+  bool stop_ticker_ = false;
+  std::thread playback_ticker_;
+
+  // helps the refresh job sanitize descriptions, which takes one of the
+  // parse threads itself, null with a single parse thread
+  std::unique_ptr<ThreadPool> description_workers_;
+
+  // destroyed right after the refresh worker, finishing the calls and parses
+  // still running on it
+  ThreadPool workers_;
+
+  // runs the refresh job, whose transfers would otherwise hold one of
+  // workers_ and keep the calls waiting; destroyed first
+  ThreadPool refresh_worker_;
+
   friend class PlaybackController;
+  friend class UpdatesWriter;
   friend class XferInfoCallbackFunctor;
 };
 }  // namespace podcaster
\ No newline at end of file
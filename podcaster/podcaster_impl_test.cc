@@ -1,7 +1,19 @@
 #include "podcaster/podcaster_impl.h"
 
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
 #include <catch2/catch_test_macros.hpp>
 
+#include "podcaster/database_utils.h"
+#include "podcaster/test_utils.h"
+
 TEST_CASE("Parse description, swallow newlines") {
   auto parsed = podcaster::ParseDescription("foo<br><br><br><br>bar");
   REQUIRE(parsed.short_description == "foo\n\nbar\n");
@@ -47,4 +59,31 @@ TEST_CASE("Download filename") {
           "podcast-313-arena-1-bilance-herniho-roku-2024.m4a?player_key="
           "asdasdasdasdasdas&publication=modrak") ==
       "17656004699637619210_podcast-313-arena-1-bilance-herniho-roku-2024.m4a");
+}
+
+TEST_CASE("Clearing the data directory keeps the socket") {
+  auto data_dir = podcaster::testing::TempDataDir("clear_data_dir");
+  for (const char* filename :
+       {"config.textproto", "metrics.prom", "db.bin", "1_foo.mp3"}) {
+    std::ofstream(data_dir / filename) << "x";
+  }
+  std::filesystem::create_directories(data_dir / "leftovers");
+
+  auto socket_path = data_dir / podcaster::utils::kSocketName;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  socket_path.string().copy(addr.sun_path, sizeof(addr.sun_path) - 1);
+  REQUIRE(bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+
+  podcaster::ClearDataDir(data_dir);
+  close(fd);
+
+  std::vector<std::string> kept;
+  for (const auto& entry : std::filesystem::directory_iterator(data_dir)) {
+    kept.push_back(entry.path().filename());
+  }
+  std::sort(kept.begin(), kept.end());
+  REQUIRE(kept == std::vector<std::string>{"config.textproto", "metrics.prom",
+                                           podcaster::utils::kSocketName});
 }
\ No newline at end of file
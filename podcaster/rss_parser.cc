@@ -0,0 +1,417 @@
+// SPDX-FileCopyrightText: 2025 Tomas Krupka
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "podcaster/rss_parser.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+#include <pugixml.hpp>
+#include <spdlog/fmt/fmt.h>
+
+namespace podcaster {
+
+namespace {
+
+constexpr std::string_view kWhitespace = " \t\r\n";
+
+enum class TextKind { kText, kCData, kAttribute };
+
+bool IsWhitespace(std::string_view text) {
+  return text.find_first_not_of(kWhitespace) == std::string_view::npos;
+}
+
+void AppendUtf8(char32_t code_point, std::string* out) {
+  if (code_point < 0x80) {
+    out->push_back(static_cast<char>(code_point));
+  } else if (code_point < 0x800) {
+    out->push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+    out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  } else if (code_point < 0x10000) {
+    out->push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+    out->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+    out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  } else {
+    out->push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+    out->push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+    out->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+    out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  }
+}
+
+// Length of the entity at the start of text, appended to out decoded; 0 if
+// it isn't one pugi would decode.
+size_t DecodeEntity(std::string_view text, std::string* out) {
+  auto end = text.find(';');
+  if (end == std::string_view::npos) {
+    return 0;
+  }
+  auto name = text.substr(1, end - 1);
+  if (name == "lt") {
+    out->push_back('<');
+  } else if (name == "gt") {
+    out->push_back('>');
+  } else if (name == "amp") {
+    out->push_back('&');
+  } else if (name == "apos") {
+    out->push_back('\'');
+  } else if (name == "quot") {
+    out->push_back('"');
+  } else if (name.size() > 1 and name[0] == '#') {
+    bool hex = name[1] == 'x';
+    auto digits = name.substr(hex ? 2 : 1);
+    if (digits.empty() or
+        not std::all_of(digits.begin(), digits.end(), [hex](char c) {
+          return hex ? std::isxdigit(c) : std::isdigit(c);
+        })) {
+      return 0;
+    }
+    AppendUtf8(std::strtoul(std::string(digits).c_str(), nullptr,
+                            hex ? 16 : 10),
+               out);
+  } else {
+    return 0;
+  }
+  return end + 1;
+}
+
+// Appends text with line endings normalized to \n and, unless it is CDATA,
+// entities decoded. In attribute values whitespace becomes spaces.
+void AppendText(std::string_view text, TextKind kind, std::string* out) {
+  for (size_t i = 0; i < text.size(); i++) {
+    char c = text[i];
+    if (c == '&' and kind != TextKind::kCData) {
+      if (size_t length = DecodeEntity(text.substr(i), out)) {
+        i += length - 1;
+        continue;
+      }
+    } else if (c == '\r') {
+      if (i + 1 < text.size() and text[i + 1] == '\n') {
+        i++;
+      }
+      c = '\n';
+    }
+    if (kind == TextKind::kAttribute and (c == '\n' or c == '\t')) {
+      c = ' ';
+    }
+    out->push_back(c);
+  }
+}
+
+// The value of the named attribute in the start tag, raw.
+std::string_view FindAttribute(std::string_view tag, std::string_view name) {
+  size_t pos = tag.find_first_of(kWhitespace);
+  while (pos < tag.size()) {
+    pos = tag.find_first_not_of(kWhitespace, pos);
+    if (pos == std::string_view::npos) {
+      break;
+    }
+    auto equals = tag.find('=', pos);
+    if (equals == std::string_view::npos) {
+      break;
+    }
+    auto attribute = tag.substr(pos, equals - pos);
+    attribute.remove_suffix(attribute.size() -
+                            attribute.find_last_not_of(kWhitespace) - 1);
+    auto quote = tag.find_first_of("\"'", equals);
+    if (quote == std::string_view::npos) {
+      break;
+    }
+    auto end = tag.find(tag[quote], quote + 1);
+    if (end == std::string_view::npos) {
+      break;
+    }
+    if (attribute == name) {
+      return tag.substr(quote + 1, end - quote - 1);
+    }
+    pos = end + 1;
+  }
+  return {};
+}
+
+// End of the markup at the start of buffer that ends with '>', skipping
+// quoted strings and, in a DOCTYPE, the internal subset.
+size_t FindTagEnd(std::string_view buffer) {
+  char quote = 0;
+  int brackets = 0;
+  for (size_t i = 1; i < buffer.size(); i++) {
+    char c = buffer[i];
+    if (quote) {
+      quote = c == quote ? 0 : quote;
+    } else if (c == '"' or c == '\'') {
+      quote = c;
+    } else if (c == '[') {
+      brackets++;
+    } else if (c == ']') {
+      brackets--;
+    } else if (c == '>' and brackets <= 0) {
+      return i;
+    }
+  }
+  return std::string_view::npos;
+}
+
+}  // namespace
+
+RssStreamParser::RssStreamParser(size_t max_items) : max_items_(max_items) {}
+
+size_t RssStreamParser::Feed(std::string_view data) {
+  if (done_ or not error_.empty()) {
+    return 0;
+  }
+  // bytes from earlier chunks, already reported as consumed
+  size_t earlier = buffer_.size();
+  buffer_.append(data);
+
+  size_t pos = 0;
+  if (not started_) {
+    if (buffer_.size() < 4) {
+      return data.size();
+    }
+    started_ = true;
+    auto first = static_cast<unsigned char>(buffer_[0]);
+    if (first == 0 or first == 0xFE or first == 0xFF or buffer_[1] == 0) {
+      // UTF-16 or UTF-32
+      fallback_ = true;
+    } else if (buffer_.starts_with("\xEF\xBB\xBF")) {
+      pos = 3;
+    }
+  }
+
+  while (not fallback_ and not done_ and error_.empty() and
+         pos < buffer_.size()) {
+    size_t length = ParseToken(std::string_view(buffer_).substr(pos));
+    if (length == 0) {
+      break;
+    }
+    pos += length;
+  }
+
+  if (fallback_) {
+    // the whole body is parsed by Finish
+    return data.size();
+  }
+  buffer_.erase(0, pos);
+  erased_ += pos;
+  if (not error_.empty()) {
+    return 0;
+  }
+  return done_ ? pos - earlier : data.size();
+}
+
+bool RssStreamParser::Finish(std::string* error) {
+  if (fallback_ or not started_) {
+    // the whole body is still buffered
+    feed_ = {};
+    return ParseRssDocument(buffer_, max_items_, &feed_, error);
+  }
+  if (not done_ and error_.empty()) {
+    if (not IsWhitespace(buffer_)) {
+      Fail("Unexpected end of data");
+    } else if (not root_closed_) {
+      Fail(stack_.empty() ? "No document element found"
+                          : "Unexpected end of data");
+    }
+  }
+  if (not error_.empty()) {
+    *error = fmt::format("Failed to parse feed: {}", error_);
+    return false;
+  }
+  return true;
+}
+
+size_t RssStreamParser::ParseToken(std::string_view buffer) {
+  if (buffer[0] != '<') {
+    auto end = buffer.find('<');
+    if (end == std::string_view::npos) {
+      return 0;
+    }
+    Text(buffer.substr(0, end));
+    return end;
+  }
+
+  if (buffer.starts_with("<!--")) {
+    auto end = buffer.find("-->", 4);
+    return end == std::string_view::npos ? 0 : end + 3;
+  }
+  if (buffer.starts_with("<![CDATA[")) {
+    auto end = buffer.find("]]>", 9);
+    if (end == std::string_view::npos) {
+      return 0;
+    }
+    CData(buffer.substr(9, end - 9));
+    return end + 3;
+  }
+  // could still become one of the above
+  if (std::string_view("<![CDATA[").starts_with(buffer) or
+      std::string_view("<!--").starts_with(buffer)) {
+    return 0;
+  }
+  if (buffer.starts_with("<?")) {
+    auto end = buffer.find("?>", 2);
+    if (end == std::string_view::npos) {
+      return 0;
+    }
+    // only the first token may declare the encoding
+    if (buffer.starts_with("<?xml ") and erased_ == 0) {
+      ParseDeclaration(buffer.substr(0, end));
+    }
+    return end + 2;
+  }
+
+  auto end = FindTagEnd(buffer);
+  if (end == std::string_view::npos) {
+    return 0;
+  }
+  if (buffer.starts_with("</")) {
+    auto name = buffer.substr(2, end - 2);
+    ParseEndTag(name.substr(0, name.find_last_not_of(kWhitespace) + 1));
+  } else if (not buffer.starts_with("<!")) {
+    ParseStartTag(buffer.substr(0, end + 1));
+  }
+  return end + 1;
+}
+
+void RssStreamParser::ParseStartTag(std::string_view token) {
+  bool self_closing = token.ends_with("/>");
+  auto name = token.substr(1, token.find_first_of(" \t\r\n/>", 1) - 1);
+  if (name.empty()) {
+    Fail("Error parsing start element tag");
+    return;
+  }
+  if (stack_.empty() and root_closed_) {
+    Fail("Unexpected data after the document element");
+    return;
+  }
+  stack_.emplace_back(name);
+
+  bool in_channel =
+      stack_.size() >= 2 and stack_[0] == "rss" and stack_[1] == "channel";
+  if (in_channel and stack_.size() == 3) {
+    if (name == "item") {
+      in_item_ = true;
+      has_title_ = has_description_ = has_enclosure_ = false;
+      feed_.items.emplace_back();
+    } else if (name == "title" and not has_channel_title_) {
+      has_channel_title_ = true;
+      Capture(Field::kChannelTitle);
+    }
+  } else if (in_item_ and stack_.size() == 4) {
+    // only the first of each, like select_node
+    if (name == "title" and not has_title_) {
+      has_title_ = true;
+      Capture(Field::kTitle);
+    } else if (name == "description" and not has_description_) {
+      has_description_ = true;
+      Capture(Field::kDescription);
+    } else if (name == "enclosure" and not has_enclosure_) {
+      has_enclosure_ = true;
+      AppendText(FindAttribute(token.substr(0, token.size() - 1), "url"),
+                 TextKind::kAttribute, &feed_.items.back().enclosure_url);
+    }
+  }
+
+  if (self_closing) {
+    ParseEndTag(name);
+  }
+}
+
+void RssStreamParser::ParseEndTag(std::string_view name) {
+  if (stack_.empty() or stack_.back() != name) {
+    Fail("Start-end tags mismatch");
+    return;
+  }
+  if (stack_.size() == capture_depth_) {
+    capture_ = Field::kNone;
+  }
+  if (in_item_ and stack_.size() == 3) {
+    in_item_ = false;
+    if (feed_.items.size() >= max_items_) {
+      done_ = true;
+    }
+  }
+  stack_.pop_back();
+  root_closed_ = stack_.empty();
+}
+
+void RssStreamParser::ParseDeclaration(std::string_view token) {
+  auto encoding = FindAttribute(token, "encoding");
+  std::string lower(encoding);
+  std::transform(lower.begin(), lower.end(), lower.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  if (not lower.empty() and lower != "utf-8" and lower != "utf8" and
+      lower != "us-ascii" and lower != "ascii") {
+    fallback_ = true;
+  }
+}
+
+void RssStreamParser::Capture(Field field) {
+  capture_ = field;
+  capture_depth_ = stack_.size();
+}
+
+std::string* RssStreamParser::TakeCapture() {
+  if (capture_ == Field::kNone or stack_.size() != capture_depth_) {
+    return nullptr;
+  }
+  // text() is the first text or CDATA child only
+  auto field = capture_;
+  capture_ = Field::kNone;
+  switch (field) {
+    case Field::kChannelTitle:
+      return &feed_.title;
+    case Field::kTitle:
+      return &feed_.items.back().title;
+    default:
+      return &feed_.items.back().description;
+  }
+}
+
+void RssStreamParser::Text(std::string_view text) {
+  // like pugi, whitespace-only text between markup is dropped
+  if (IsWhitespace(text)) {
+    return;
+  }
+  if (auto* target = TakeCapture()) {
+    AppendText(text, TextKind::kText, target);
+  }
+}
+
+void RssStreamParser::CData(std::string_view text) {
+  if (auto* target = TakeCapture()) {
+    AppendText(text, TextKind::kCData, target);
+  }
+}
+
+void RssStreamParser::Fail(std::string error) {
+  if (error_.empty()) {
+    error_ = std::move(error);
+  }
+}
+
+bool ParseRssDocument(std::string_view body, size_t max_items, RssFeed* feed,
+                      std::string* error) {
+  pugi::xml_document doc;
+  pugi::xml_parse_result result = doc.load_buffer(body.data(), body.size());
+  if (!result) {
+    *error = fmt::format("Failed to parse feed: {}", result.description());
+    return false;
+  }
+
+  auto channel = doc.child("rss").child("channel");
+  feed->title = channel.child("title").text().as_string();
+  for (auto item : channel.children("item")) {
+    if (feed->items.size() >= max_items) {
+      break;
+    }
+    auto& parsed = feed->items.emplace_back();
+    parsed.title = item.child("title").text().as_string();
+    parsed.description = item.child("description").text().as_string();
+    parsed.enclosure_url =
+        item.child("enclosure").attribute("url").as_string();
+  }
+  return true;
+}
+
+}  // namespace podcaster
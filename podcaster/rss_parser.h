@@ -0,0 +1,103 @@
+// SPDX-FileCopyrightText: 2025 Tomas Krupka
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace podcaster {
+
+// The fields of one /rss/channel/item, descriptions still raw HTML.
+struct RssItem {
+  std::string title;
+  std::string description;
+  std::string enclosure_url;
+};
+
+struct RssFeed {
+  std::string title;
+  // in document order, newest first in a well-behaved feed
+  std::vector<RssItem> items;
+};
+
+// Push parser for RSS feeds, fed the body in chunks while it downloads.
+// Extracts the channel title and the first max_items items in one pass and
+// reports when it has them, so that the rest of a large feed needn't be
+// downloaded or parsed at all. A channel title following the items is
+// missed.
+//
+// Text is extracted like pugi's xml_node::text() with the default parse
+// options. Feeds declaring an encoding other than UTF-8 are buffered and
+// parsed with ParseRssDocument instead.
+class RssStreamParser {
+ public:
+  explicit RssStreamParser(size_t max_items);
+
+  // Bytes of data consumed, less than data.size() once Done, the rest of
+  // the body is not needed.
+  size_t Feed(std::string_view data);
+
+  bool Done() const { return done_; }
+
+  // Call after the last chunk, false if the document is malformed with the
+  // reason in error.
+  bool Finish(std::string* error);
+
+  RssFeed& Result() { return feed_; }
+
+ private:
+  enum class Field { kNone, kChannelTitle, kTitle, kDescription };
+
+  // Parses one token at the start of buffer, 0 if it is incomplete.
+  size_t ParseToken(std::string_view buffer);
+
+  void ParseStartTag(std::string_view token);
+  void ParseEndTag(std::string_view name);
+  void ParseDeclaration(std::string_view token);
+
+  // Extracts the text of the element just opened.
+  void Capture(Field field);
+  // Where the text goes if it is the first of the captured element, the
+  // capture ends with it.
+  std::string* TakeCapture();
+
+  void Text(std::string_view text);
+  void CData(std::string_view text);
+
+  void Fail(std::string error);
+
+  const size_t max_items_;
+
+  // received and not parsed yet, at most an incomplete token
+  std::string buffer_;
+  // parsed and dropped from the front of buffer_
+  size_t erased_ = 0;
+  bool started_ = false;
+  bool fallback_ = false;
+  bool done_ = false;
+  bool root_closed_ = false;
+  std::string error_;
+
+  std::vector<std::string> stack_;
+  bool in_item_ = false;
+  bool has_channel_title_ = false;
+  bool has_title_ = false;
+  bool has_description_ = false;
+  bool has_enclosure_ = false;
+
+  // the element whose text is being extracted, at depth capture_depth_
+  Field capture_ = Field::kNone;
+  size_t capture_depth_ = 0;
+
+  RssFeed feed_;
+};
+
+// Parses a whole RSS document with pugixml, keeping the first max_items
+// items, false on failure with the reason in error.
+bool ParseRssDocument(std::string_view body, size_t max_items, RssFeed* feed,
+                      std::string* error);
+
+}  // namespace podcaster
@@ -0,0 +1,119 @@
+#include "podcaster/rss_parser.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <spdlog/fmt/fmt.h>
+
+namespace {
+
+constexpr std::string_view kFeed = R"(<?xml version="1.0" encoding="UTF-8"?>
+<!-- generated -->
+<rss version="2.0" xmlns:itunes="http://www.itunes.com/dtds/podcast-1.0.dtd">
+  <channel>
+    <title>Tom &amp; Jerry</title>
+    <description>Channel description</description>
+    <item>
+      <title><![CDATA[Episode <3>]]></title>
+      <itunes:title>Not this one</itunes:title>
+      <description>&lt;p&gt;Hello&#x21;&lt;/p&gt;</description>
+      <enclosure url="https://example.com/3.mp3?a=1&amp;b=2" type="audio/mpeg"/>
+    </item>
+    <item>
+      <title>Episode 2</title>
+      <description>
+        <![CDATA[<p>Second</p>]]>
+      </description>
+      <enclosure type="audio/mpeg" url='https://example.com/2.mp3'></enclosure>
+      <enclosure url="https://example.com/other.mp3"/>
+    </item>
+    <item>
+      <title>Episode 1</title>
+    </item>
+  </channel>
+</rss>
+)";
+
+podcaster::RssFeed ParseInChunks(std::string_view body, size_t max_items,
+                                 size_t chunk_size,
+                                 size_t* consumed = nullptr) {
+  podcaster::RssStreamParser parser(max_items);
+  size_t total = 0;
+  for (size_t pos = 0; pos < body.size(); pos += chunk_size) {
+    auto chunk = body.substr(pos, chunk_size);
+    size_t used = parser.Feed(chunk);
+    total += used;
+    if (used < chunk.size()) {
+      REQUIRE(parser.Done());
+      break;
+    }
+  }
+  std::string error;
+  REQUIRE(parser.Finish(&error));
+  REQUIRE(error.empty());
+  if (consumed) {
+    *consumed = total;
+  }
+  return std::move(parser.Result());
+}
+
+}  // namespace
+
+TEST_CASE("Stream parser extracts the channel and items") {
+  for (size_t chunk_size : {size_t{1}, size_t{7}, size_t{64}, kFeed.size()}) {
+    auto feed = ParseInChunks(kFeed, 10, chunk_size);
+    REQUIRE(feed.title == "Tom & Jerry");
+    REQUIRE(feed.items.size() == 3);
+
+    REQUIRE(feed.items[0].title == "Episode <3>");
+    REQUIRE(feed.items[0].description == "<p>Hello!</p>");
+    REQUIRE(feed.items[0].enclosure_url ==
+            "https://example.com/3.mp3?a=1&b=2");
+
+    REQUIRE(feed.items[1].title == "Episode 2");
+    REQUIRE(feed.items[1].description == "<p>Second</p>");
+    REQUIRE(feed.items[1].enclosure_url == "https://example.com/2.mp3");
+
+    REQUIRE(feed.items[2].title == "Episode 1");
+    REQUIRE(feed.items[2].description.empty());
+    REQUIRE(feed.items[2].enclosure_url.empty());
+  }
+}
+
+TEST_CASE("Stream parser stops after enough items") {
+  std::string body = "<rss><channel><title>Big</title>";
+  for (int i = 0; i < 1000; i++) {
+    body += fmt::format("<item><title>{}</title></item>", i);
+  }
+  body += "</channel></rss>";
+
+  for (size_t chunk_size : {size_t{1}, size_t{100}, body.size()}) {
+    size_t consumed = 0;
+    auto feed = ParseInChunks(body, 2, chunk_size, &consumed);
+    REQUIRE(feed.title == "Big");
+    REQUIRE(feed.items.size() == 2);
+    REQUIRE(feed.items[1].title == "1");
+    // up to the end of the last item kept, wherever the chunks split
+    REQUIRE(std::string_view(body).substr(0, consumed).ends_with(
+        "<item><title>1</title></item>"));
+  }
+}
+
+TEST_CASE("Stream parser reports malformed feeds") {
+  for (std::string_view body :
+       {"", "<rss><channel></rss>", "<rss><channel><item>",
+        "<rss></rss><rss></rss>", "<rss><!-- unterminated"}) {
+    podcaster::RssStreamParser parser(10);
+    parser.Feed(body);
+    std::string error;
+    REQUIRE_FALSE(parser.Finish(&error));
+    REQUIRE(error.starts_with("Failed to parse feed: "));
+  }
+}
+
+TEST_CASE("Stream parser normalizes line endings") {
+  auto feed = ParseInChunks(
+      "<rss><channel><item><title>a\r\nb\rc</title>"
+      "<enclosure url=\"x\ty\"/></item></channel></rss>",
+      10, 5);
+  REQUIRE(feed.items[0].title == "a\nb\nc");
+  REQUIRE(feed.items[0].enclosure_url == "x y");
+}
@@ -0,0 +1,74 @@
+// SPDX-FileCopyrightText: 2025 Tomas Krupka
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace podcaster {
+
+// Bounded lock-free queue for exactly one producer and one consumer thread.
+// Neither side ever waits on the other, a full queue refuses the push.
+template <typename T>
+class SpscQueue {
+ public:
+  // Capacity is rounded up to a power of two.
+  explicit SpscQueue(size_t capacity)
+      : slots_(std::bit_ceil(std::max<size_t>(capacity, 2))),
+        mask_(slots_.size() - 1) {}
+
+  SpscQueue(const SpscQueue&) = delete;
+  SpscQueue& operator=(const SpscQueue&) = delete;
+  SpscQueue(SpscQueue&&) = delete;
+  SpscQueue& operator=(SpscQueue&&) = delete;
+
+  // Producer only, false if the queue is full, value is only moved from on
+  // success.
+  bool TryPush(T&& value) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == slots_.size()) {
+      return false;
+    }
+    slots_[tail & mask_] = std::move(value);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer only, empty if there is nothing queued.
+  std::optional<T> TryPop() {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+      return {};
+    }
+    std::optional<T> value = std::move(slots_[head & mask_]);
+    // release what the slot owns now rather than when it is reused
+    slots_[head & mask_] = T{};
+    head_.store(head + 1, std::memory_order_release);
+    return value;
+  }
+
+  // Only a hint when called by neither the producer nor the consumer.
+  bool Empty() const {
+    return head_.load(std::memory_order_acquire) ==
+           tail_.load(std::memory_order_acquire);
+  }
+
+  size_t Capacity() const { return slots_.size(); }
+
+ private:
+  std::vector<T> slots_;
+  const size_t mask_;
+
+  // the indices only grow, their difference is the queue size; kept on
+  // separate cache lines so that both sides don't invalidate each other
+  alignas(64) std::atomic<size_t> head_ = 0;
+  alignas(64) std::atomic<size_t> tail_ = 0;
+};
+
+}  // namespace podcaster
@@ -0,0 +1,78 @@
+#include "podcaster/spsc_queue.h"
+
+#include <memory>
+#include <thread>
+
+#include <catch2/catch_test_macros.hpp>
+
+TEST_CASE("Queue capacity is rounded up to a power of two") {
+  REQUIRE(podcaster::SpscQueue<int>(0).Capacity() == 2);
+  REQUIRE(podcaster::SpscQueue<int>(5).Capacity() == 8);
+  REQUIRE(podcaster::SpscQueue<int>(64).Capacity() == 64);
+}
+
+TEST_CASE("Full queue refuses pushes, values pop in order") {
+  podcaster::SpscQueue<int> queue(4);
+  REQUIRE(queue.Empty());
+  REQUIRE_FALSE(queue.TryPop());
+
+  for (int i = 0; i < 4; i++) {
+    REQUIRE(queue.TryPush(int{i}));
+  }
+  REQUIRE_FALSE(queue.TryPush(4));
+
+  REQUIRE(queue.TryPop() == 0);
+  REQUIRE(queue.TryPush(4));
+  for (int i = 1; i <= 4; i++) {
+    REQUIRE(queue.TryPop() == i);
+  }
+  REQUIRE(queue.Empty());
+}
+
+TEST_CASE("Refused push keeps the value") {
+  podcaster::SpscQueue<std::unique_ptr<int>> queue(2);
+  REQUIRE(queue.TryPush(std::make_unique<int>(0)));
+  REQUIRE(queue.TryPush(std::make_unique<int>(1)));
+
+  auto value = std::make_unique<int>(2);
+  REQUIRE_FALSE(queue.TryPush(std::move(value)));
+  REQUIRE(value);
+}
+
+TEST_CASE("Popped slot releases the value") {
+  podcaster::SpscQueue<std::shared_ptr<int>> queue(2);
+  auto value = std::make_shared<int>(0);
+  REQUIRE(queue.TryPush(std::shared_ptr<int>(value)));
+  REQUIRE(value.use_count() == 2);
+
+  queue.TryPop();
+  REQUIRE(value.use_count() == 1);
+}
+
+TEST_CASE("Values cross threads in order") {
+  constexpr int kNumValues = 1000000;
+  podcaster::SpscQueue<int> queue(16);
+
+  std::thread producer([&] {
+    for (int i = 0; i < kNumValues; i++) {
+      while (not queue.TryPush(int{i})) {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  int expected = 0;
+  bool in_order = true;
+  while (expected < kNumValues) {
+    if (auto value = queue.TryPop()) {
+      in_order &= *value == expected;
+      expected++;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  producer.join();
+
+  REQUIRE(in_order);
+  REQUIRE(queue.Empty());
+}
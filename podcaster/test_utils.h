@@ -0,0 +1,16 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+
+namespace podcaster::testing {
+
+// An empty directory for one test case, cleared of a previous run's files.
+inline std::filesystem::path TempDataDir(const std::string& name) {
+  auto path = std::filesystem::temp_directory_path() / "podcaster_test" / name;
+  std::filesystem::remove_all(path);
+  std::filesystem::create_directories(path);
+  return path;
+}
+
+}  // namespace podcaster::testing
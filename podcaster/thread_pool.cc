@@ -0,0 +1,85 @@
+// SPDX-FileCopyrightText: 2025 Tomas Krupka
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "podcaster/thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <latch>
+#include <memory>
+
+namespace podcaster {
+
+ThreadPool::ThreadPool(int num_threads) {
+  for (int i = 0; i < std::max(num_threads, 1); i++) {
+    threads_.emplace_back([this] { Worker(); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    stopped_ = true;
+  }
+  cv_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+void ThreadPool::Submit(std::function<void()> job) {
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    jobs_.push_back(std::move(job));
+  }
+  cv_.notify_one();
+}
+
+void ThreadPool::ParallelFor(size_t count,
+                             const std::function<void(size_t)>& func) {
+  if (count == 0) {
+    return;
+  }
+  // outlives the call for helpers that start after the last index
+  struct State {
+    explicit State(size_t count) : count(count), done(count) {}
+    const size_t count;
+    std::atomic<size_t> next = 0;
+    std::latch done;
+    const std::function<void(size_t)>* func = nullptr;
+  };
+  auto state = std::make_shared<State>(count);
+  state->func = &func;
+
+  auto work = [](State* state) {
+    for (size_t index = state->next++; index < state->count;
+         index = state->next++) {
+      (*state->func)(index);
+      state->done.count_down();
+    }
+  };
+  size_t helpers = std::min(count - 1, threads_.size());
+  for (size_t i = 0; i < helpers; i++) {
+    Submit([state, work] { work(state.get()); });
+  }
+  work(state.get());
+  state->done.wait();
+}
+
+void ThreadPool::Worker() {
+  std::unique_lock<std::mutex> lock(mtx_);
+  while (true) {
+    cv_.wait(lock, [this] { return stopped_ or not jobs_.empty(); });
+    if (jobs_.empty()) {
+      return;
+    }
+    auto job = std::move(jobs_.front());
+    jobs_.pop_front();
+
+    lock.unlock();
+    job();
+    lock.lock();
+  }
+}
+
+}  // namespace podcaster
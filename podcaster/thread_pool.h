@@ -0,0 +1,48 @@
+// SPDX-FileCopyrightText: 2025 Tomas Krupka
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace podcaster {
+
+// Fixed number of threads running submitted jobs in order.
+class ThreadPool {
+ public:
+  explicit ThreadPool(int num_threads);
+  // Runs the jobs already submitted, then joins the threads.
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+  ThreadPool(ThreadPool&&) = delete;
+  ThreadPool& operator=(ThreadPool&&) = delete;
+
+  void Submit(std::function<void()> job);
+
+  // Runs func(0) .. func(count - 1) on the pool and the calling thread,
+  // returns once all are done. The calling thread works through the
+  // indices too, so it may be one of the pool's own.
+  void ParallelFor(size_t count, const std::function<void(size_t)>& func);
+
+  int Size() const { return threads_.size(); }
+
+ private:
+  void Worker();
+
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::deque<std::function<void()>> jobs_;
+  bool stopped_ = false;
+
+  std::vector<std::thread> threads_;
+};
+
+}  // namespace podcaster
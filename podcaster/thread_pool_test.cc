@@ -0,0 +1,44 @@
+#include "podcaster/thread_pool.h"
+
+#include <atomic>
+#include <latch>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+TEST_CASE("ParallelFor runs every index once") {
+  podcaster::ThreadPool pool(3);
+  for (size_t count : {size_t{0}, size_t{1}, size_t{2}, size_t{100}}) {
+    std::vector<std::atomic<int>> runs(count);
+    pool.ParallelFor(count, [&](size_t index) { runs[index]++; });
+    for (const auto& run : runs) {
+      REQUIRE(run == 1);
+    }
+  }
+}
+
+TEST_CASE("ParallelFor finishes with the pool busy") {
+  podcaster::ThreadPool pool(1);
+  std::latch release(1);
+  pool.Submit([&] { release.wait(); });
+
+  // the calling thread does all the work while the helper is queued
+  std::atomic<int> runs = 0;
+  pool.ParallelFor(10, [&](size_t) { runs++; });
+  REQUIRE(runs == 10);
+  release.count_down();
+}
+
+TEST_CASE("ParallelFor can be called from the pool") {
+  podcaster::ThreadPool pool(2);
+  std::atomic<int> runs = 0;
+  std::latch done(2);
+  for (int i = 0; i < 2; i++) {
+    pool.Submit([&] {
+      pool.ParallelFor(50, [&](size_t) { runs++; });
+      done.count_down();
+    });
+  }
+  done.wait();
+  REQUIRE(runs == 100);
+}
@@ -3,8 +3,6 @@
 
 #include "podcaster/tidy_utils.h"
 
-#include <memory>
-
 #include <spdlog/spdlog.h>
 #include <tidy.h>
 #include <tidybuffio.h>
@@ -12,58 +10,102 @@
 
 namespace tidy {
 
+namespace {
+
 // Example code:  https://www.html-tidy.org/developer/
 
-std::string ConvertToXHTML(const std::string& input) {
-  auto free_tdoc = [](TidyDoc* doc) { tidyRelease(*doc); };
-  std::unique_ptr<TidyDoc, decltype(free_tdoc)> tdoc(new TidyDoc{tidyCreate()},
-                                                     free_tdoc);
-
-  auto free_tbuf = [](TidyBuffer* buf) { tidyBufFree(buf); };
-  std::unique_ptr<TidyBuffer, decltype(free_tbuf)> output(new TidyBuffer{0},
-                                                          free_tbuf);
-  std::unique_ptr<TidyBuffer, decltype(free_tbuf)> errbuf(new TidyBuffer{0},
-                                                          free_tbuf);
-
-  if (not tdoc or not output or not errbuf) {
-    spdlog::error("Failed to allocate memory for tidy");
-    return {input};
+// A configured document and its buffers, reused for every conversion on a
+// thread. Parsing into a document frees the previous tree and the options
+// are restored from a snapshot after each save, like the tidy command line
+// tool processing several files.
+class Converter {
+ public:
+  Converter() {
+    tidyBufInit(&output_);
+    tidyBufInit(&errbuf_);
   }
 
-  bool all_ok = true;
-  all_ok &= tidyOptSetBool(*tdoc, TidyXhtmlOut, yes) != 0;
-  all_ok &= tidyOptSetBool(*tdoc, TidyQuoteAmpersand, no) != 0;
-  all_ok &= tidyOptSetBool(*tdoc, TidyQuoteMarks, no) != 0;
-  all_ok &= tidyOptSetBool(*tdoc, TidyQuoteNbsp, no) != 0;
-  all_ok &= tidyOptSetInt(*tdoc, TidyWrapLen, 0) != 0;
-  if (not all_ok) {
-    spdlog::error("HTML-tidy configuration error");
-    return {input};
+  ~Converter() {
+    Reset();
+    tidyBufFree(&output_);
+    tidyBufFree(&errbuf_);
   }
 
-  auto ret = tidySetErrorBuffer(*tdoc, errbuf.get());  // Capture diagnostics
-  if (ret >= 0) {
-    ret = tidyParseString(*tdoc, input.c_str());  // Parse the input
-  }
-  if (ret >= 0) {
-    ret = tidyCleanAndRepair(*tdoc);  // Tidy it up!
-  }
-  if (ret >= 0) {
-    ret = tidyRunDiagnostics(*tdoc);  // Kvetch
-  }
-  if (ret > 1) {  // If error, force output.
-    ret = (tidyOptSetBool(*tdoc, TidyForceOutput, yes) != 0) ? ret : -1;
+  Converter(const Converter&) = delete;
+  Converter& operator=(const Converter&) = delete;
+
+  std::string Convert(const std::string& input) {
+    if (not tdoc_ and not Configure()) {
+      return {input};
+    }
+    tidyBufClear(&output_);
+    tidyBufClear(&errbuf_);
+
+    auto ret = tidyParseString(tdoc_, input.c_str());  // Parse the input
+    if (ret >= 0) {
+      ret = tidyCleanAndRepair(tdoc_);  // Tidy it up!
+    }
+    if (ret >= 0) {
+      ret = tidyRunDiagnostics(tdoc_);  // Kvetch
+    }
+    if (ret > 1) {  // If error, force output.
+      ret = (tidyOptSetBool(tdoc_, TidyForceOutput, yes) != 0) ? ret : -1;
+    }
+    if (ret >= 0) {
+      ret = tidySaveBuffer(tdoc_, &output_);  // Pretty Print
+    }
+
+    if (ret < 0) {
+      spdlog::error("XHTML conversion error: {}", ret);
+      // start over with a fresh document next time
+      Reset();
+      return {input};
+    }
+
+    return std::string(reinterpret_cast<char*>(output_.bp), output_.size);
   }
-  if (ret >= 0) {
-    ret = tidySaveBuffer(*tdoc, output.get());  // Pretty Print
+
+ private:
+  bool Configure() {
+    tdoc_ = tidyCreate();
+    if (not tdoc_) {
+      spdlog::error("Failed to allocate memory for tidy");
+      return false;
+    }
+
+    bool all_ok = true;
+    all_ok &= tidyOptSetBool(tdoc_, TidyXhtmlOut, yes) != 0;
+    all_ok &= tidyOptSetBool(tdoc_, TidyQuoteAmpersand, no) != 0;
+    all_ok &= tidyOptSetBool(tdoc_, TidyQuoteMarks, no) != 0;
+    all_ok &= tidyOptSetBool(tdoc_, TidyQuoteNbsp, no) != 0;
+    all_ok &= tidyOptSetInt(tdoc_, TidyWrapLen, 0) != 0;
+    // Capture diagnostics
+    all_ok &= tidySetErrorBuffer(tdoc_, &errbuf_) >= 0;
+    if (not all_ok) {
+      spdlog::error("HTML-tidy configuration error");
+      Reset();
+      return false;
+    }
+    return true;
   }
 
-  if (ret < 0) {
-    spdlog::error("XHTML conversion error: {}", ret);
-    return {input};
+  void Reset() {
+    if (tdoc_) {
+      tidyRelease(tdoc_);
+      tdoc_ = nullptr;
+    }
   }
 
-  std::string result(reinterpret_cast<char*>(output->bp), output->size);
-  return result;
+  TidyDoc tdoc_ = nullptr;
+  TidyBuffer output_;
+  TidyBuffer errbuf_;
+};
+
+}  // namespace
+
+std::string ConvertToXHTML(const std::string& input) {
+  thread_local Converter converter;
+  return converter.Convert(input);
 }
-}  // namespace tidy
\ No newline at end of file
+
+}  // namespace tidy
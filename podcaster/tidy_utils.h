@@ -6,5 +6,6 @@
 #include <string>
 
 namespace tidy {
+    // Safe to call from several threads, each keeps its own tidy document.
     std::string ConvertToXHTML(const std::string& input);
 }
\ No newline at end of file
@@ -0,0 +1,81 @@
+// SPDX-FileCopyrightText: 2025 Tomas Krupka
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "podcaster/update_table.h"
+
+#include <algorithm>
+#include <functional>
+#include <string_view>
+
+namespace podcaster {
+
+size_t UpdateTable::KeyHash::operator()(const Key& key) const {
+  size_t hash = std::hash<std::string_view>{}(key.podcast_uri);
+  hash = hash * 31 + std::hash<std::string_view>{}(key.episode_uri);
+  return hash * 31 + static_cast<size_t>(key.status);
+}
+
+UpdateTable::Key UpdateTable::KeyOf(const EpisodeUpdate& update) {
+  return {update.uri().podcast_uri(), update.uri().episode_uri(),
+          update.status_case()};
+}
+
+void UpdateTable::Put(const EpisodeUpdate& update) {
+  auto [iter, inserted] = index_.try_emplace(KeyOf(update));
+  if (not inserted) {
+    entries_.erase(iter->second);
+  }
+  entries_.push_back({update, ++sequence_});
+  iter->second = std::prev(entries_.end());
+}
+
+UpdateTable::SubscriberId UpdateTable::Subscribe() {
+  SubscriberId subscriber = ++last_subscriber_;
+  cursors_.emplace(subscriber, 0);
+  return subscriber;
+}
+
+void UpdateTable::Unsubscribe(SubscriberId subscriber) {
+  cursors_.erase(subscriber);
+  Trim();
+}
+
+std::vector<EpisodeUpdate> UpdateTable::Read(SubscriberId subscriber) {
+  auto cursor = cursors_.find(subscriber);
+  if (cursor == cursors_.end()) {
+    return {};
+  }
+
+  // the unread entries are at the back
+  auto first = entries_.end();
+  while (first != entries_.begin() and
+         std::prev(first)->sequence > cursor->second) {
+    first--;
+  }
+  std::vector<EpisodeUpdate> updates;
+  for (auto iter = first; iter != entries_.end(); iter++) {
+    updates.push_back(iter->update);
+  }
+
+  cursor->second = sequence_;
+  Trim();
+  return updates;
+}
+
+void UpdateTable::Trim() {
+  if (cursors_.empty()) {
+    return;
+  }
+  uint64_t read_by_all =
+      std::min_element(cursors_.begin(), cursors_.end(),
+                       [](const auto& a, const auto& b) {
+                         return a.second < b.second;
+                       })
+          ->second;
+  while (not entries_.empty() and entries_.front().sequence <= read_by_all) {
+    index_.erase(KeyOf(entries_.front().update));
+    entries_.pop_front();
+  }
+}
+
+}  // namespace podcaster
@@ -0,0 +1,75 @@
+// SPDX-FileCopyrightText: 2025 Tomas Krupka
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "podcaster/message.pb.h"
+
+namespace podcaster {
+
+// Episode updates waiting for the EpisodeUpdates subscribers. Only the
+// latest update per episode and status kind is kept, every change moves it
+// behind all others. Each subscriber has a cursor, so it reads every change
+// exactly once no matter how many others read the table. Updates read by
+// all subscribers are dropped, without subscribers they are kept for the
+// next one.
+//
+// Not thread-safe.
+class UpdateTable {
+ public:
+  using SubscriberId = uint64_t;
+
+  // Replaces the update of the same episode and kind, O(1).
+  void Put(const EpisodeUpdate& update);
+
+  // The new subscriber first reads the updates still in the table.
+  SubscriberId Subscribe();
+
+  void Unsubscribe(SubscriberId subscriber);
+
+  // Updates changed since the subscriber's last read, least recently
+  // changed first.
+  std::vector<EpisodeUpdate> Read(SubscriberId subscriber);
+
+  size_t Size() const { return entries_.size(); }
+
+ private:
+  struct Key {
+    std::string podcast_uri;
+    std::string episode_uri;
+    EpisodeUpdate::StatusCase status;
+
+    bool operator==(const Key& other) const = default;
+  };
+
+  struct KeyHash {
+    size_t operator()(const Key& key) const;
+  };
+
+  struct Entry {
+    EpisodeUpdate update;
+    uint64_t sequence;
+  };
+
+  static Key KeyOf(const EpisodeUpdate& update);
+
+  // Drops the entries all subscribers have read.
+  void Trim();
+
+  // ordered by sequence
+  std::list<Entry> entries_;
+  std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index_;
+  uint64_t sequence_ = 0;
+
+  // last sequence each subscriber read
+  std::unordered_map<SubscriberId, uint64_t> cursors_;
+  SubscriberId last_subscriber_ = 0;
+};
+
+}  // namespace podcaster
@@ -0,0 +1,96 @@
+#include "podcaster/update_table.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+namespace {
+
+podcaster::EpisodeUpdate Progress(const std::string& episode_uri,
+                                  int position_ms) {
+  podcaster::EpisodeUpdate update;
+  update.mutable_uri()->set_podcast_uri("pod1");
+  update.mutable_uri()->set_episode_uri(episode_uri);
+  update.set_new_playback_progress(position_ms);
+  return update;
+}
+
+podcaster::EpisodeUpdate Status(const std::string& episode_uri,
+                                podcaster::PlaybackStatus status) {
+  podcaster::EpisodeUpdate update;
+  update.mutable_uri()->set_podcast_uri("pod1");
+  update.mutable_uri()->set_episode_uri(episode_uri);
+  update.set_new_playback_status(status);
+  return update;
+}
+
+}  // namespace
+
+TEST_CASE("Updates of the same episode and kind are coalesced") {
+  podcaster::UpdateTable table;
+  auto subscriber = table.Subscribe();
+
+  table.Put(Progress("ep1", 1000));
+  table.Put(Status("ep1", podcaster::PLAYING));
+  table.Put(Progress("ep2", 500));
+  table.Put(Progress("ep1", 2000));
+  REQUIRE(table.Size() == 3);
+
+  auto updates = table.Read(subscriber);
+  REQUIRE(updates.size() == 3);
+  // the latest change comes last
+  REQUIRE(updates[0].new_playback_status() == podcaster::PLAYING);
+  REQUIRE(updates[1].uri().episode_uri() == "ep2");
+  REQUIRE(updates[2].uri().episode_uri() == "ep1");
+  REQUIRE(updates[2].new_playback_progress() == 2000);
+}
+
+TEST_CASE("Every subscriber reads every change once") {
+  podcaster::UpdateTable table;
+  auto gui = table.Subscribe();
+  auto script = table.Subscribe();
+
+  table.Put(Progress("ep1", 1000));
+  REQUIRE(table.Read(gui).size() == 1);
+  REQUIRE(table.Read(gui).empty());
+
+  table.Put(Progress("ep2", 500));
+  REQUIRE(table.Read(gui).size() == 1);
+
+  auto updates = table.Read(script);
+  REQUIRE(updates.size() == 2);
+  REQUIRE(updates[0].uri().episode_uri() == "ep1");
+  REQUIRE(updates[1].uri().episode_uri() == "ep2");
+  REQUIRE(table.Read(script).empty());
+}
+
+TEST_CASE("Updates read by all subscribers are dropped") {
+  podcaster::UpdateTable table;
+  auto first = table.Subscribe();
+  auto second = table.Subscribe();
+
+  table.Put(Progress("ep1", 1000));
+  table.Read(first);
+  REQUIRE(table.Size() == 1);
+  table.Read(second);
+  REQUIRE(table.Size() == 0);
+
+  // a subscriber going away no longer holds updates back
+  table.Put(Progress("ep1", 2000));
+  table.Read(first);
+  table.Unsubscribe(second);
+  REQUIRE(table.Size() == 0);
+}
+
+TEST_CASE("Updates without subscribers wait for the next one") {
+  podcaster::UpdateTable table;
+  table.Put(Progress("ep1", 1000));
+  table.Put(Progress("ep1", 2000));
+
+  auto subscriber = table.Subscribe();
+  auto updates = table.Read(subscriber);
+  REQUIRE(updates.size() == 1);
+  REQUIRE(updates[0].new_playback_progress() == 2000);
+
+  // coalesced again after being read
+  table.Put(Progress("ep1", 3000));
+  REQUIRE(table.Read(subscriber).size() == 1);
+}